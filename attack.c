@@ -51,6 +51,7 @@ void attack_city(piece_info_t *att_obj, loc_t loc) {
   } else { /* attack succeeded */
     kill_city(cityp);
     cityp->owner = att_owner;
+    vmap_forget_fields(); /* even if the city was unowned */
     kill_obj(att_obj, loc);
 
     if (att_owner == USER) {
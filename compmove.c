@@ -15,27 +15,165 @@ For each move the user wants us to make, we do the following:
     3)  Check to see if the game is over.
 */
 
+#include <pthread.h>
 #include <string.h>
 #include "empire.h"
 #include "extern.h"
 
-static view_map_t emap[MAP_SIZE]; /* pruned explore map */
+static view_map_t *emap;   /* pruned explore map */
+static loc_t *emap_marks;  /* cells the pruned map predicts */
+static long emap_nmarks;
+
+/* weights of cities on the unload map; see make_unload_map() */
+static int *unload_cont;
+static scan_counts_t *unload_counts;
+static char *unload_weight;     /* digit for each city, or 0 */
+static view_map_t *unload_vmap; /* map the weights were made for */
+static long unload_version;     /* and its version at the time */
+
+/* names for the terrain of maps made with unmark_explore_locs() */
+static long xmap_terrain;      /* name of current terrain */
+static long xmap_view_terrain; /* terrain of comp_map when it was named */
+
+/* the computer's cities, for comp_prod(); see analyze_cities() */
+static struct {
+  bool valid;
+  long version;               /* vmap_cont_version(comp_map) when made */
+  int producers[NUM_OBJECTS]; /* cities producing each piece */
+  int total;                  /* cities producing anything */
+} cities;
+static int *city_cont;   /* continent of each computer city, or -1 */
+static int *cont_armies; /* army producers on each continent, by label + 1 */
+
+static view_map_t *amap; /* temp view map */
+static path_map_t path_map;
+static path_map_t path_map2; /* second path map for armies */
+
+/*
+Planning.  Most of the time an army takes to move goes to its search
+for a loading transport, across land and water on the load map.  With
+more than one thread (the -t option), we make these searches for a
+batch of armies at once, the threads taking armies from the batch in
+turn, all on the load map as it stands before any army of the batch
+has moved.  The armies then move one at a time in the usual order.
+An army whose plan is still good when it moves takes the objective
+and path map from the plan; any other searches as before.
+
+A plan is still good if no cell of the load map next to a cell the
+search reached has changed in a way that matters to it.  We watch
+comp_map for cells that change, and compare the marks of the two load
+maps.  The search sees a piece as the terrain under it, so only a
+change to or from unexplored territory, at a city, or to or from an
+objective can matter.
+
+The load search need only beat the army's land objective, which the
+thread finds first with a search of its own.  A plan made to beat some
+cost holds for any smaller cost too.  A good plan finds what the army's
+own search would, so the game goes the same way on any number of
+threads.
+*/
+
+#define PLANS_PER_THREAD 4
+
+typedef struct {
+  loc_t loc;     /* cell marked */
+  char contents; /* and its mark */
+} mark_t;
+
+typedef struct {
+  piece_info_t *obj; /* army planned for, or NULL once used */
+  loc_t loc;         /* where it was */
+  int beat_cost;     /* cost its objective had to beat */
+  loc_t dest;        /* objective found, or 'loc' */
+  int cost;          /* and the cost of the objective */
+  path_map_t pmap;   /* path map of the search */
+} plan_t;
+
+static plan_t *plans;
+static int nplans;              /* plans in the batch */
+static piece_info_t *plan_next; /* first army of the next batch */
+static view_map_t *plan_map;    /* load map the batch was planned on */
+static mark_t *plan_marks;      /* and its marks */
+static long nplan_marks;
+static perimeter_t plan_changes; /* cells of comp_map changed since */
+static mark_t *load_marks;       /* marks of the last load map made */
+static long nload_marks;
+static path_map_t *land_maps; /* each thread's land search */
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t start; /* a batch is ready */
+  pthread_cond_t done;  /* the threads are through with it */
+  int threads;          /* threads started, besides our own */
+  long batch;           /* batches begun */
+  int next;             /* next plan of the batch to make */
+  int busy;             /* threads still at work on it */
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+          PTHREAD_COND_INITIALIZER};
 
 bool load_army(piece_info_t *obj);
+static void alloc_plans(void);
+static void *plan_thread(void *arg);
+static void plan_armies(piece_info_t *first);
+static void make_plans(void);
+static path_map_t *use_plan(piece_info_t *obj, int beat_cost, loc_t *dest);
+static int load_beat_cost(path_map_t *pmap, loc_t loc, loc_t new_loc);
+static long list_load_marks(mark_t *marks, piece_info_t *obj);
 bool lake(loc_t loc);
 bool overproduced(city_info_t *cityp, int *city_count);
 bool nearby_load(piece_info_t *obj, loc_t loc);
 count_t nearby_count(loc_t loc);
-void move_objective(piece_info_t *obj, path_map_t pathmap[], loc_t new_loc,
+void move_objective(piece_info_t *obj, path_map_t *pathmap, loc_t new_loc,
                     char *adj_list);
 void comp_set_prod(city_info_t *, int);
 void comp_set_needed(city_info_t *, int *, bool, bool);
 void comp_prod(city_info_t *, bool);
 
+/* Allocate the maps used to move the computer's pieces. */
+
+void alloc_comp(void) {
+  emap = xalloc(MAP_SIZE, sizeof(view_map_t));
+  emap_marks = xalloc(MAP_SIZE, sizeof(loc_t));
+  unload_cont = xalloc(MAP_SIZE, sizeof(int));
+  unload_counts = xalloc(MAP_SIZE + 1, sizeof(scan_counts_t));
+  unload_weight = xalloc(NUM_CITY, sizeof(char));
+  city_cont = xalloc(NUM_CITY, sizeof(int));
+  cont_armies = xalloc(MAP_SIZE + 1, sizeof(int));
+  amap = xalloc(MAP_SIZE, sizeof(view_map_t));
+  alloc_pmap(&path_map);
+  alloc_pmap(&path_map2);
+  load_marks = xalloc(LIST_SIZE + NUM_CITY, sizeof(mark_t));
+  if (plan_threads > 1) alloc_plans();
+}
+
+/* Allocate the plans and start the threads that make them. */
+
+static void alloc_plans(void) {
+  pthread_t thread;
+  int i;
+
+  plans = xalloc(plan_threads * PLANS_PER_THREAD, sizeof(plan_t));
+  for (i = 0; i < plan_threads * PLANS_PER_THREAD; i++)
+    alloc_pmap(&plans[i].pmap);
+  land_maps = xalloc(plan_threads, sizeof(path_map_t));
+  for (i = 0; i < plan_threads; i++) alloc_pmap(&land_maps[i]);
+  plan_map = xalloc(MAP_SIZE, sizeof(view_map_t));
+  plan_marks = xalloc(LIST_SIZE + NUM_CITY, sizeof(mark_t));
+  alloc_perimeter(&plan_changes);
+
+  while (pool.threads < plan_threads - 1 &&
+         pthread_create(&thread, NULL, plan_thread,
+                        &land_maps[pool.threads + 1]) == 0) {
+    (void)pthread_detach(thread);
+    pool.threads += 1;
+  }
+}
+
 void comp_move(int nmoves) {
   void do_cities(), do_pieces(), check_endgame();
 
   int i;
+  loc_t loc;
   piece_info_t *obj;
 
   /* Update our view of the world. */
@@ -47,8 +185,15 @@ void comp_move(int nmoves) {
   for (i = 1; i <= nmoves; i++) { /* for each move we get... */
     comment("Thinking...");
 
-    (void)memcpy(emap, comp_map, MAP_SIZE * sizeof(view_map_t));
-    vmap_prune_explore_locs(emap);
+    vmap_copy(emap, comp_map);
+    vmap_prune_explore_locs(emap, comp_map);
+    emap_nmarks = 0;
+    for (loc = 0; loc < MAP_SIZE; loc++)
+      if (map[loc].on_board && emap[loc].contents != comp_map[loc].contents)
+        emap_marks[emap_nmarks++] = loc;
+    unload_vmap = NULL; /* unload weights depend on emap */
+    xmap_terrain += 1;  /* and so does the terrain of unmarked maps */
+    vmap_set_terrain(emap, xmap_terrain); /* which emap has too */
 
     do_cities(); /* handle city production */
     do_pieces(); /* move pieces */
@@ -80,6 +225,8 @@ void do_cities(void) {
   int i;
   bool is_lake;
 
+  cities.valid = false; /* cities may have changed hands */
+
   for (i = 0; i < NUM_CITY; i++) /* new production */
     if (city[i].owner == COMP) {
       scan(comp_map, city[i].loc);
@@ -114,6 +261,41 @@ static int ratio3[NUM_OBJECTS] = {120, 20, 20, 10, 10, 60, 10, 10, 0};
 static int ratio4[NUM_OBJECTS] = {150, 30, 30, 20, 20, 70, 10, 10, 0};
 static int *ratio;
 
+/*
+Count the computer's cities by what they produce, and the army
+producers on each continent.  Cities only change hands between calls
+to do_cities(), so we count them once a turn, and again when the
+continents of comp_map change.  comp_set_prod() keeps the counts up
+to date as production changes.
+*/
+
+static void analyze_cities(void) {
+  int i;
+  city_info_t *p;
+
+  if (cities.valid && cities.version == vmap_cont_version(comp_map)) return;
+
+  for (i = 0; i < NUM_CITY; i++) cont_armies[city_cont[i] + 1] = 0;
+  for (i = 0; i < NUM_OBJECTS; i++) cities.producers[i] = 0;
+  cities.total = 0;
+
+  for (i = 0; i < NUM_CITY; i++) {
+    p = &city[i];
+    city_cont[i] = -1;
+    if (p->owner != COMP) continue;
+
+    city_cont[i] = vmap_cont_label(comp_map, p->loc, MAP_SEA);
+    if (p->prod != NOPIECE) {
+      cities.producers[(int)p->prod] += 1;
+      cities.total += 1;
+    }
+    if (p->prod == ARMY && comp_map[p->loc].contents == 'X')
+      cont_armies[city_cont[i] + 1] += 1;
+  }
+  cities.valid = true;
+  cities.version = vmap_cont_version(comp_map);
+}
+
 /*
 Set city production if necessary.
 
@@ -128,31 +310,19 @@ The algorithm below contains three parts:
 
 void comp_prod(city_info_t *cityp, bool is_lake) {
   int city_count[NUM_OBJECTS]; /* # of cities producing each piece */
-  int cont_map[MAP_SIZE];
   int total_cities;
   count_t i;
   int comp_ac;
-  city_info_t *p;
   int need_count, interest;
   scan_counts_t counts;
 
   /* Make sure we have army producers for current continent. */
 
-  /* map out city's continent */
-  vmap_cont(cont_map, comp_map, cityp->loc, MAP_SEA);
+  /* count items of interest on the city's continent */
+  analyze_cities();
+  counts = vmap_cont_counts(comp_map, cityp->loc, MAP_SEA);
+  comp_ac = cont_armies[city_cont[cityp - city] + 1];
 
-  /* count items of interest on the continent */
-  counts = vmap_cont_scan(cont_map, comp_map);
-  comp_ac = 0; /* no army producing computer cities */
-
-  for (i = 0; i < MAP_SIZE; i++)
-    if (cont_map[i]) { /* for each cell of continent */
-      if (comp_map[i].contents == 'X') {
-        p = find_city(i);
-        ASSERT(p != NULL && p->owner == COMP);
-        if (p->prod == ARMY) comp_ac += 1;
-      }
-    }
   /* see if anything of interest is on continent */
   interest = (counts.unexplored || counts.user_cities ||
               counts.user_objects[ARMY] || counts.unowned_cities);
@@ -176,15 +346,10 @@ void comp_prod(city_info_t *cityp, bool is_lake) {
   /* Produce a TT and SAT if we don't have one. */
 
   /* count # of cities producing each piece */
-  for (i = 0; i < NUM_OBJECTS; i++) city_count[i] = 0;
+  for (i = 0; i < NUM_OBJECTS; i++) city_count[i] = cities.producers[i];
 
-  total_cities = 0;
+  total_cities = cities.total;
 
-  for (i = 0; i < NUM_CITY; i++)
-    if (city[i].owner == COMP && city[i].prod != NOPIECE) {
-      city_count[(int)city[i].prod] += 1;
-      total_cities += 1;
-    }
   if (total_cities <= 10)
     ratio = ratio1;
   else if (total_cities <= 20)
@@ -253,10 +418,24 @@ reset production if it is already correct.
 */
 
 void comp_set_prod(city_info_t *cityp, int type) {
+  int *armies;
+
   if (cityp->prod == type) return;
 
   pdebug("Changing city prod at %d from %d to %d\n", loc_disp(cityp->loc),
          cityp->prod, type);
+  if (cities.valid) { /* keep the counts of analyze_cities() */
+    armies = &cont_armies[city_cont[cityp - city] + 1];
+    if (cityp->prod != NOPIECE)
+      cities.producers[(int)cityp->prod] -= 1;
+    else
+      cities.total += 1;
+    cities.producers[type] += 1;
+    if (comp_map[cityp->loc].contents == 'X') {
+      if (cityp->prod == ARMY) *armies -= 1;
+      if (type == ARMY) *armies += 1;
+    }
+  }
   cityp->prod = type;
   cityp->work = -(piece_attr[type].build_time / 5);
 }
@@ -326,25 +505,19 @@ unexplored territory will be land or water.  The prediction should
 be helpful, because small bodies of water that enclose unexplored
 territory will appear as solid water.  Big bodies of water should
 have unexplored territory on the edges.
+
+The bodies of water are the basins of emap, which count what is
+next to them.  If we can't tell, we take the water to be open.
 */
 
 bool lake(loc_t loc) {
-  int cont_map[MAP_SIZE];
-  scan_counts_t counts;
-
-  vmap_cont(cont_map, emap, loc, MAP_LAND); /* map lake */
-  counts = vmap_cont_scan(cont_map, emap);
-
-  return !(counts.unowned_cities || counts.user_cities || counts.unexplored);
+  return vmap_basin_count(emap, COMP, loc, " *O") == 0;
 }
 
 /*
 Move all computer pieces.
 */
 
-static view_map_t amap[MAP_SIZE]; /* temp view map */
-static path_map_t path_map[MAP_SIZE];
-
 void do_pieces(void) {
   void cpiece_move();
 
@@ -352,12 +525,171 @@ void do_pieces(void) {
   piece_info_t *obj, *next_obj;
 
   for (i = 0; i < NUM_OBJECTS; i++) { /* loop through obj lists */
+    if (move_order[i] == ARMY) plan_next = comp_obj[ARMY];
     for (obj = comp_obj[move_order[i]]; obj != NULL;
          obj = next_obj) { /* loop through objs in list */
       next_obj = obj->piece_link.next;
+      if (obj == plan_next && plan_threads > 1) plan_armies(obj);
       cpiece_move(obj); /* yup; move the object */
     }
   }
+  vmap_watch(NULL, NULL); /* plans are only good for a turn */
+  nplans = 0;
+}
+
+/*
+Plan the load searches for a batch of armies, starting with 'first'.
+We plan for the armies that may look for a transport, unless there
+is nothing to load onto.  Armies on a land mass with nowhere to sail
+to never look, and since vmap_crossing() answers a land mass at a
+time, asking for each army costs little.
+*/
+
+static void plan_armies(piece_info_t *first) {
+  piece_info_t *obj;
+  loc_t loc;
+  long i;
+
+  nplans = 0;
+  for (obj = first; obj != NULL && nplans < plan_threads * PLANS_PER_THREAD;
+       obj = obj->piece_link.next)
+    if (!obj->ship && !vmap_at_sea(comp_map, obj->loc) &&
+        vmap_crossing(comp_map, COMP, obj->loc, "O* ") != INFINITY) {
+      plans[nplans].obj = obj;
+      plans[nplans].loc = obj->loc;
+      nplans += 1;
+    }
+  plan_next = obj;
+
+  nplan_marks = list_load_marks(plan_marks, NULL);
+  if (nplan_marks == 0) nplans = 0; /* the searches give up at once */
+  if (nplans == 0) return;
+
+  for (loc = 0; loc < MAP_SIZE; loc++)
+    plan_map[loc].contents = comp_map[loc].contents;
+  for (i = 0; i < nplan_marks; i++)
+    plan_map[plan_marks[i].loc].contents = plan_marks[i].contents;
+
+  vmap_prepare(&army_fight);
+  vmap_prepare(&army_load);
+  vmap_watch(comp_map, &plan_changes);
+  make_plans();
+  path_stats.plans_made += nplans;
+}
+
+/* Make one plan, as army_move() would search for the army. */
+
+static void make_plan(plan_t *pp, path_map_t *land_map) {
+  loc_t new_loc;
+
+  new_loc = vmap_plan_lobj(land_map, comp_map, pp->loc, &army_fight);
+  pp->beat_cost = load_beat_cost(land_map, pp->loc, new_loc);
+  pp->dest = pp->loc;
+  pp->cost = pp->beat_cost;
+
+  if (pp->beat_cost > 0) /* else the army won't look for a transport */
+    pp->dest = vmap_plan_lwobj(&pp->pmap, plan_map, pp->loc, &army_load,
+                               pp->beat_cost, &pp->cost);
+}
+
+/*
+Make the plans of the batch that no other thread has taken.  Called
+with the pool locked.
+*/
+
+static void run_plans(path_map_t *land_map) {
+  int i;
+
+  while (pool.next < nplans) {
+    i = pool.next++;
+    (void)pthread_mutex_unlock(&pool.lock);
+    make_plan(&plans[i], land_map);
+    (void)pthread_mutex_lock(&pool.lock);
+  }
+}
+
+/* A thread that makes plans, with its own path map for land searches. */
+
+static void *plan_thread(void *arg) {
+  long batch = 0;
+
+  (void)pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    while (pool.batch == batch) (void)pthread_cond_wait(&pool.start, &pool.lock);
+    batch = pool.batch;
+    run_plans(arg);
+    if (--pool.busy == 0) (void)pthread_cond_signal(&pool.done);
+  }
+  return NULL;
+}
+
+/* Make the plans of a batch, with the help of every thread. */
+
+static void make_plans(void) {
+  (void)pthread_mutex_lock(&pool.lock);
+  pool.next = 0;
+  pool.busy = pool.threads;
+  pool.batch += 1;
+  (void)pthread_cond_broadcast(&pool.start);
+
+  run_plans(&land_maps[0]);
+  while (pool.busy > 0) (void)pthread_cond_wait(&pool.done, &pool.lock);
+  (void)pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+Return true iff a cell of the load map differs from the map a plan
+was made on, in a way that matters, next to a cell its search reached.
+*/
+
+static bool spoils(plan_t *pp, loc_t loc) {
+  int old_contents = plan_map[loc].contents;
+  int new_contents = amap[loc].contents;
+  path_map_t *pmap = &pp->pmap;
+  loc_t new_loc;
+  int i;
+
+  if (old_contents == new_contents) return false;
+  if (old_contents != ' ' && new_contents != ' ' && !map[loc].cityp &&
+      army_load.cost[(uchar)old_contents] ==
+          army_load.cost[(uchar)new_contents])
+    return false;
+
+  if (pmap->stamp[loc] == pmap->gen) return true;
+  FOR_ADJ(loc, new_loc, i)
+  if (new_loc >= 0 && new_loc < MAP_SIZE && pmap->stamp[new_loc] == pmap->gen)
+    return true;
+  return false;
+}
+
+/*
+Called when an army about to search the load map in 'amap' has a
+plan.  If the plan is still good, we return its path map and put its
+objective in 'dest'; otherwise we return NULL.
+*/
+
+static path_map_t *use_plan(piece_info_t *obj, int beat_cost, loc_t *dest) {
+  plan_t *pp;
+  long i;
+
+  for (i = 0; i < nplans; i++)
+    if (plans[i].obj == obj) break;
+  if (i == nplans) return NULL;
+
+  pp = &plans[i];
+  pp->obj = NULL; /* a plan is used once */
+  if (pp->loc != obj->loc || beat_cost > pp->beat_cost) return NULL;
+
+  for (i = 0; i < plan_changes.len; i++)
+    if (spoils(pp, plan_changes.list[i])) return NULL;
+  for (i = 0; i < nplan_marks; i++)
+    if (spoils(pp, plan_marks[i].loc)) return NULL;
+  for (i = 0; i < nload_marks; i++)
+    if (spoils(pp, load_marks[i].loc)) return NULL;
+
+  path_stats.plans_used += 1;
+  *dest = pp->cost < beat_cost ? pp->dest : obj->loc;
+  return &pp->pmap;
 }
 
 /*
@@ -451,9 +783,10 @@ also figure out how close a loadable tt must be to be of
 interest.  If the objective is closer than the tt must be,
 head towards the objective.
 
-4)  Otherwise, look for the nearest loading tt (or tt producing
-city).  If the nearest loading tt is farther than our land objective,
-head towards the land objective.
+4)  Otherwise, if a transport could carry us to another continent
+with a city to take or territory to explore, look for the nearest
+loading tt (or tt producing city).  If the nearest loading tt is
+farther than our land objective, head towards the land objective.
 
 5)  Otherwise, head for the tt.
 
@@ -471,8 +804,8 @@ void army_move(piece_info_t *obj) {
   void board_ship();
 
   loc_t new_loc;
-  path_map_t path_map2[MAP_SIZE];
-  int cross_cost = 0; /* cost to enter water */
+  int cross_cost; /* cost to enter water */
+  path_map_t *pmap;
 
   obj->func = 0;                         /* army doesn't want a tt */
   if (vmap_at_sea(comp_map, obj->loc)) { /* army can't move? */
@@ -501,58 +834,81 @@ void army_move(piece_info_t *obj) {
       return;                     /* armies stay on a loading ship */
     }
     make_unload_map(amap, comp_map);
-    new_loc = vmap_find_wlobj(path_map, amap, obj->loc, &tt_unload);
-    move_objective(obj, path_map, new_loc, " ");
+    new_loc = vmap_find_wlobj(&path_map, amap, obj->loc, &tt_unload);
+    move_objective(obj, &path_map, new_loc, " ");
     return;
   }
 
-  new_loc = vmap_find_lobj(path_map, comp_map, obj->loc, &army_fight);
+  new_loc = vmap_find_lobj(&path_map, comp_map, obj->loc, &army_fight);
+  cross_cost = load_beat_cost(&path_map, obj->loc, new_loc);
 
-  if (new_loc != obj->loc) { /* something interesting on land? */
-    switch (comp_map[new_loc].contents) {
-      case 'A':
-      case 'O':
-        cross_cost = 60; /* high cost if enemy present */
-        break;
-      case MAP_CITY:
-        cross_cost = 30; /* medium cost for attackable city */
-        break;
-      case ' ':
-        cross_cost = 14; /* low cost for exploring */
-        break;
-      default:
-        ABORT;
-    }
-    cross_cost = path_map[new_loc].cost * 2 - cross_cost;
-  } else
-    cross_cost = INFINITY;
-
-  if (new_loc == obj->loc || cross_cost > 0) {
+  /* look for a ship only if it could take us somewhere */
+  if ((new_loc == obj->loc || cross_cost > 0) &&
+      vmap_crossing(comp_map, COMP, obj->loc, "O* ") != INFINITY) {
     loc_t new_loc2;
     /* see if there is something interesting to load */
     make_army_load_map(obj, amap, comp_map);
-    new_loc2 =
-        vmap_find_lwobj(path_map2, amap, obj->loc, &army_load, cross_cost);
-
+    pmap = use_plan(obj, cross_cost, &new_loc2);
+    if (pmap == NULL) {
+      pmap = &path_map2;
+      new_loc2 = vmap_find_lwobj(pmap, amap, obj->loc, &army_load, cross_cost);
+    }
     if (new_loc2 != obj->loc) { /* found something? */
-      board_ship(obj, path_map2, new_loc2);
+      board_ship(obj, pmap, new_loc2);
       return;
     }
   }
 
-  move_objective(obj, path_map, new_loc, " ");
+  move_objective(obj, &path_map, new_loc, " ");
 }
 
 /*
-Remove pruned explore locs from a view map.
+Return the cost a loading transport must beat for an army at 'loc',
+given the land objective it found with 'pmap'.
+*/
+
+static int load_beat_cost(path_map_t *pmap, loc_t loc, loc_t new_loc) {
+  int cross_cost = 0;
+
+  if (new_loc == loc) return INFINITY; /* nothing interesting on land */
+
+  switch (comp_map[new_loc].contents) {
+    case 'A':
+    case 'O':
+      cross_cost = 60; /* high cost if enemy present */
+      break;
+    case MAP_CITY:
+      cross_cost = 30; /* medium cost for attackable city */
+      break;
+    case ' ':
+      cross_cost = 14; /* low cost for exploring */
+      break;
+    default:
+      ABORT;
+  }
+  return pmap_cost(pmap, new_loc) * 2 - cross_cost;
+}
+
+/*
+Remove pruned explore locs from a view map.  Only the cells the
+pruned map predicts can change, so we only look at those.
 */
 
 void unmark_explore_locs(view_map_t *xmap) {
   count_t i;
+  loc_t loc;
+
+  for (i = 0; i < emap_nmarks; i++) {
+    loc = emap_marks[i];
+    if (xmap[loc].contents == ' ')
+      vmap_set_contents(xmap, loc, emap[loc].contents);
+  }
 
-  for (i = 0; i < MAP_SIZE; i++)
-    if (map[i].on_board && xmap[i].contents == ' ')
-      xmap[i].contents = emap[i].contents;
+  if (vmap_terrain(comp_map) != xmap_view_terrain) {
+    xmap_view_terrain = vmap_terrain(comp_map);
+    xmap_terrain += 1;
+  }
+  vmap_set_terrain(xmap, xmap_terrain);
 }
 
 /*
@@ -561,25 +917,47 @@ transport and tt producing city with a '$'.
 */
 
 void make_army_load_map(piece_info_t *obj, view_map_t *xmap, view_map_t *vmap) {
+  long i;
+
+  vmap_overlay(xmap, vmap);
+
+  nload_marks = list_load_marks(load_marks, obj);
+  for (i = 0; i < nload_marks; i++)
+    vmap_set_contents(xmap, load_marks[i].loc, load_marks[i].contents);
+
+  if (print_vmap == 'A') print_xzoom(xmap);
+}
+
+/*
+List the marks of a load map for an army, in the order they are made.
+A NULL army is one that wants no transport, as every army searching
+the load map is; plans are made for such an army.
+*/
+
+static long list_load_marks(mark_t *marks, piece_info_t *obj) {
   piece_info_t *p;
+  long n = 0;
   int i;
 
-  (void)memcpy(xmap, vmap, sizeof(view_map_t) * MAP_SIZE);
-
   /* mark loading transports or cities building transports */
   for (p = comp_obj[TRANSPORT]; p; p = p->piece_link.next)
-    if (p->func == 0) /* loading tt? */
-      xmap[p->loc].contents = '$';
+    if (p->func == 0) { /* loading tt? */
+      marks[n].loc = p->loc;
+      marks[n].contents = '$';
+      n += 1;
+    }
 
   for (i = 0; i < NUM_CITY; i++)
     if (city[i].owner == COMP && city[i].prod == TRANSPORT) {
-      if (nearby_load(obj, city[i].loc))
-        xmap[city[i].loc].contents = 'x'; /* army is nearby so it can load */
-      else if (nearby_count(city[i].loc) < piece_attr[TRANSPORT].capacity)
-        xmap[city[i].loc].contents = 'x'; /* city needs armies */
+      if ((obj && nearby_load(obj, city[i].loc)) /* army can load */
+          || nearby_count(city[i].loc) <
+                 piece_attr[TRANSPORT].capacity) { /* city needs armies */
+        marks[n].loc = city[i].loc;
+        marks[n].contents = 'x';
+        n += 1;
+      }
     }
-
-  if (print_vmap == 'A') print_xzoom(xmap);
+  return n;
 }
 
 /* Return true if an army is considered near a location for loading. */
@@ -591,14 +969,7 @@ bool nearby_load(piece_info_t *obj, loc_t loc) {
 /* Return number of nearby armies. */
 
 count_t nearby_count(loc_t loc) {
-  piece_info_t *obj;
-  int count;
-
-  count = 0;
-  for (obj = comp_obj[ARMY]; obj; obj = obj->piece_link.next) {
-    if (nearby_load(obj, loc)) count += 1;
-  }
-  return count;
+  return count_near(COMP, ARMY, loc, 2, 1); /* as nearby_load() has it */
 }
 
 /* Make load map for a ship. */
@@ -606,21 +977,19 @@ count_t nearby_count(loc_t loc) {
 void make_tt_load_map(view_map_t *xmap, view_map_t *vmap) {
   piece_info_t *p;
 
-  (void)memcpy(xmap, vmap, sizeof(view_map_t) * MAP_SIZE);
+  vmap_overlay(xmap, vmap);
 
   /* mark loading armies */
   for (p = comp_obj[ARMY]; p; p = p->piece_link.next)
     if (p->func == 1) /* loading army? */
-      xmap[p->loc].contents = '$';
+      vmap_set_contents(xmap, p->loc, '$');
 
   if (print_vmap == 'L') print_xzoom(xmap);
 }
 
 /*
-Make an unload map.  We copy the view map.  We then create
-a continent map.  For each of our cities, we mark out the continent
-that city is on.  Then, for each city that we don't own and which
-doesn't appear on our continent map, we set that square to a digit.
+Make an unload map.  We copy the view map, and then set each city
+that we don't own to a digit.
 
 We want to assign weights to each attackable city.
 Cities are more valuable if they are on a continent which
@@ -641,49 +1010,56 @@ b)  if enemy_cities == 1 && total_cities == 1, set number to 2.
        getting a two city continent ))
 
 c)  Any other attackable city is marked with a '0'.
-*/
 
-static int owncont_map[MAP_SIZE];
-static int tcont_map[MAP_SIZE];
+The weights only change when a city changes or more of the map comes
+into view, and when the explore map is rebuilt at the start of each
+turn, so we keep them from one call to the next.
+*/
 
 void make_unload_map(view_map_t *xmap, view_map_t *vmap) {
   count_t i;
-  scan_counts_t counts;
+  loc_t loc;
+  scan_counts_t *counts;
+  int total_cities;
 
-  (void)memcpy(xmap, vmap, sizeof(view_map_t) * MAP_SIZE);
+  vmap_overlay(xmap, vmap);
   unmark_explore_locs(xmap);
 
-  for (i = 0; i < MAP_SIZE; i++) owncont_map[i] = 0; /* nothing marked */
+  if (unload_vmap != vmap || unload_version != vmap_cont_version(vmap)) {
+    (void)vmap_cont_all(unload_cont, unload_counts, xmap, MAP_SEA);
 
-  for (i = 0; i < NUM_CITY; i++)
-    if (city[i].owner == COMP)
-      vmap_mark_up_cont(owncont_map, xmap, city[i].loc, MAP_SEA);
-
-  for (i = 0; i < MAP_SIZE; i++)
-    if (strchr("O*", vmap[i].contents)) {
-      int total_cities;
-
-      vmap_cont(tcont_map, xmap, i, MAP_SEA); /* map continent */
-      counts = vmap_cont_scan(tcont_map, xmap);
+    for (i = 0; i < NUM_CITY; i++) {
+      loc = city[i].loc;
+      unload_weight[i] = 0;
+      if (vmap[loc].contents != 'O' && vmap[loc].contents != MAP_CITY)
+        continue;
 
+      counts = &unload_counts[unload_cont[loc]];
       total_cities =
-          counts.unowned_cities + counts.user_cities + counts.comp_cities;
+          counts->unowned_cities + counts->user_cities + counts->comp_cities;
 
       if (total_cities > 9) total_cities = 0;
 
-      if (counts.user_cities && counts.comp_cities)
-        xmap[i].contents = '0' + total_cities;
+      if (counts->user_cities && counts->comp_cities)
+        unload_weight[i] = '0' + total_cities;
 
-      else if (counts.unowned_cities > counts.user_cities &&
-               counts.comp_cities == 0)
-        xmap[i].contents = '0' + total_cities;
+      else if (counts->unowned_cities > counts->user_cities &&
+               counts->comp_cities == 0)
+        unload_weight[i] = '0' + total_cities;
 
-      else if (counts.user_cities == 1 && counts.comp_cities == 0)
-        xmap[i].contents = '2';
+      else if (counts->user_cities == 1 && counts->comp_cities == 0)
+        unload_weight[i] = '2';
 
       else
-        xmap[i].contents = '0';
+        unload_weight[i] = '0';
     }
+    unload_vmap = vmap;
+    unload_version = vmap_cont_version(vmap);
+  }
+  for (i = 0; i < NUM_CITY; i++)
+    if (unload_weight[i])
+      vmap_set_contents(xmap, city[i].loc, unload_weight[i]);
+
   if (print_vmap == 'U') print_xzoom(xmap);
 }
 
@@ -827,20 +1203,20 @@ void transport_move(piece_info_t *obj) {
 
   if (obj->func == 0) { /* loading? */
     make_tt_load_map(amap, comp_map);
-    new_loc = vmap_find_wlobj(path_map, amap, obj->loc, &tt_load);
+    new_loc = vmap_find_wlobj(&path_map, amap, obj->loc, &tt_load);
 
     if (new_loc == obj->loc) { /* nothing to load? */
-      (void)memcpy(amap, comp_map, MAP_SIZE * sizeof(view_map_t));
+      vmap_overlay(amap, comp_map);
       unmark_explore_locs(amap);
       if (print_vmap == 'S') print_xzoom(amap);
-      new_loc = vmap_find_wobj(path_map, amap, obj->loc, &tt_explore);
+      new_loc = vmap_find_wobj(&path_map, amap, obj->loc, &tt_explore);
     }
 
-    move_objective(obj, path_map, new_loc, "a ");
+    move_objective(obj, &path_map, new_loc, "a ");
   } else {
     make_unload_map(amap, comp_map);
-    new_loc = vmap_find_wlobj(path_map, amap, obj->loc, &tt_unload);
-    move_objective(obj, path_map, new_loc, " ");
+    new_loc = vmap_find_wlobj(&path_map, amap, obj->loc, &tt_unload);
+    move_objective(obj, &path_map, new_loc, " ");
   }
 }
 
@@ -868,14 +1244,14 @@ void fighter_move(piece_info_t *obj) {
   if (obj->range <= find_nearest_city(obj->loc, COMP, &new_loc) + 2) {
     if (new_loc != obj->loc)
       new_loc =
-          vmap_find_dest(path_map, comp_map, obj->loc, new_loc, COMP, T_AIR);
+          vmap_find_dest(&path_map, comp_map, obj->loc, new_loc, COMP, T_AIR);
   } else
     new_loc = obj->loc;
 
   if (new_loc == obj->loc) { /* no nearby city? */
-    new_loc = vmap_find_aobj(path_map, comp_map, obj->loc, &fighter_fight);
+    new_loc = vmap_find_aobj(&path_map, comp_map, obj->loc, &fighter_fight);
   }
-  move_objective(obj, path_map, new_loc, " ");
+  move_objective(obj, &path_map, new_loc, " ");
 }
 
 /*
@@ -894,7 +1270,7 @@ void ship_move(piece_info_t *obj) {
       obj->moved = piece_attr[obj->type].speed;
       return;
     }
-    new_loc = vmap_find_wobj(path_map, comp_map, obj->loc, &ship_repair);
+    new_loc = vmap_find_wobj(&path_map, comp_map, obj->loc, &ship_repair);
     adj_list = ".";
 
   } else {
@@ -904,22 +1280,22 @@ void ship_move(piece_info_t *obj) {
       return;
     }
     /* look for an objective */
-    (void)memcpy(amap, comp_map, MAP_SIZE * sizeof(view_map_t));
+    vmap_overlay(amap, comp_map);
     unmark_explore_locs(amap);
     if (print_vmap == 'S') print_xzoom(amap);
 
-    new_loc = vmap_find_wobj(path_map, amap, obj->loc, &ship_fight);
+    new_loc = vmap_find_wobj(&path_map, amap, obj->loc, &ship_fight);
     adj_list = ship_fight.objectives;
   }
 
-  move_objective(obj, path_map, new_loc, adj_list);
+  move_objective(obj, &path_map, new_loc, adj_list);
 }
 
 /*
 Move to an objective.
 */
 
-void move_objective(piece_info_t *obj, path_map_t pathmap[], loc_t new_loc,
+void move_objective(piece_info_t *obj, path_map_t *pathmap, loc_t new_loc,
                     char *adj_list) {
   char *terrain;
   int d;
@@ -1019,10 +1395,10 @@ void move_objective(piece_info_t *obj, path_map_t pathmap[], loc_t new_loc,
     if (find_attack(obj->loc, attack_list, terrain) != obj->loc) return;
 
     /* clear old path */
-    pathmap[old_loc].terrain = T_UNKNOWN;
+    pathmap->terrain[old_loc] = T_UNKNOWN;
     for (d = 0; d < 8; d++) {
       new_loc = old_loc + dir_offset[d];
-      pathmap[new_loc].terrain = T_UNKNOWN;
+      pathmap->terrain[new_loc] = T_UNKNOWN;
     }
     /* pathmap is already marked, but this should work */
     move_objective(obj, pathmap, old_dest, adj_list);
@@ -1039,7 +1415,6 @@ and armies as the user, then the computer will give up.
 void check_endgame(void) {
   int nuser_city, ncomp_city;
   int nuser_army, ncomp_army;
-  piece_info_t *p;
   int i;
 
   date += 1;            /* one more turn has passed */
@@ -1047,8 +1422,6 @@ void check_endgame(void) {
 
   nuser_city = 0; /* nothing counted yet */
   ncomp_city = 0;
-  nuser_army = 0;
-  ncomp_army = 0;
 
   for (i = 0; i < NUM_CITY; i++) {
     if (city[i].owner == USER)
@@ -1057,9 +1430,8 @@ void check_endgame(void) {
       ncomp_city++;
   }
 
-  for (p = user_obj[ARMY]; p != NULL; p = p->piece_link.next) nuser_army++;
-
-  for (p = comp_obj[ARMY]; p != NULL; p = p->piece_link.next) ncomp_army++;
+  nuser_army = count_pieces(USER, ARMY);
+  ncomp_army = count_pieces(COMP, ARMY);
 
   if (ncomp_city < nuser_city / 3 && ncomp_army < nuser_army / 3) {
     clear_screen();
@@ -68,16 +68,10 @@ piece_attr_t piece_attr[] = {
     {'Z', "satellite", "satellite", "a satellite", "satellites", ".+", 50, 0, 1,
      10, 0, 500}};
 
-/* Direction offsets. */
+/* Direction offsets, north first and then clockwise.  They depend on
+   the width of the map, so init_loc_tables() fills them in. */
 
-int dir_offset[] = {-MAP_WIDTH,      /* north */
-                    -MAP_WIDTH + 1,  /* northeast */
-                    1,               /* east */
-                    MAP_WIDTH + 1,   /* southeast */
-                    MAP_WIDTH,       /* south */
-                    MAP_WIDTH - 1,   /* southwest */
-                    -1,              /* west */
-                    -MAP_WIDTH - 1}; /* northwest */
+int dir_offset[8];
 
 /* Names of movement functions. */
 
@@ -168,6 +162,13 @@ move_info_t user_fighter = {USER, " ", {1}};
 move_info_t user_ship = {USER, " ", {1}};
 move_info_t user_ship_repair = {USER, "O", {1}};
 
+/*
+Names of the kernels which expand search perimeters, for debugging.
+*/
+
+char *expand_kernel_names[NUM_EXPAND_KERNELS] = {
+    "land", "water", "air", "land by 2", "land by 2, water by 1", "general"};
+
 /*
 Various help texts.
 */
@@ -487,12 +487,12 @@ void print_pzoom_cell(path_map_t *pmap, view_map_t *vmap, int row, int col,
 
   for (r = row; r < row + row_inc; r++)
     for (c = col; c < col + col_inc; c++) {
-      sum += pmap[row_col_loc(r, c)].cost;
+      sum += pmap_cost(pmap, row_col_loc(r, c));
       d += 1;
     }
   sum /= d;
 
-  if (pmap[row_col_loc(row, col)].terrain == T_PATH)
+  if (pmap_terrain(pmap, row_col_loc(row, col)) == T_PATH)
     cell = '-';
   else if (sum < 0)
     cell = '!';
@@ -12,6 +12,7 @@ parser, and the simple commands.
 
 #include "empire.h"
 #include <stdio.h>
+#include <time.h>
 #include "extern.h"
 
 void c_examine(void), c_movie(void);
@@ -209,6 +210,7 @@ void c_give(void) {
   i = irand(count);
   i = unowned[i]; /* get city index */
   city[i].owner = COMP;
+  vmap_forget_fields();
   city[i].prod = NOPIECE;
   city[i].work = 0;
   scan(comp_map, city[i].loc);
@@ -221,6 +223,7 @@ The order cannot be any legal command.
 
 void c_debug(char order) {
   char e;
+  void c_path_stats(void), c_census(void);
 
   switch (order) {
     case '#':
@@ -254,12 +257,59 @@ void c_debug(char order) {
       print_vmap = get_chx();
       break;
 
+    case '!': /* print path statistics */
+      c_path_stats();
+      break;
+
+    case '=': /* print view map census */
+      c_census();
+      break;
+
     default:
       huh();
       break;
   }
 }
 
+/*
+Print the work done by the path routines.  Kernels are only
+counted and timed in debugging mode.
+*/
+
+void c_path_stats(void) {
+  int i;
+  double secs;
+
+  comment("Paths marked: %ld, cells marked: %ld, most in one path: %ld",
+          path_stats.mark_calls, path_stats.mark_cells, path_stats.mark_most);
+  comment("Searches skipped with nothing to find: %ld", path_stats.skipped);
+  comment("Load searches planned: %ld, still good when used: %ld",
+          path_stats.plans_made, path_stats.plans_used);
+
+  for (i = 0; i < NUM_EXPAND_KERNELS; i++) {
+    if (path_stats.expand_cells[i] == 0) continue;
+    secs = (double)path_stats.expand_ticks[i] / CLOCKS_PER_SEC;
+    comment("Kernel %s: %ld cells in %.3f seconds, %.0f cells/second",
+            expand_kernel_names[i], path_stats.expand_cells[i], secs,
+            secs > 0 ? path_stats.expand_cells[i] / secs : 0.0);
+  }
+}
+
+/*
+Print how many cells of each kind the view maps hold.
+*/
+
+void c_census(void) {
+  int c;
+
+  for (c = 1; c < 256; c++) {
+    if (vmap_census(comp_map, c) == 0 && vmap_census(user_map, c) == 0)
+      continue;
+    comment("'%c': computer %ld, user %ld", c, vmap_census(comp_map, c),
+            vmap_census(user_map, c));
+  }
+}
+
 /*
 The quit command.  Make sure the user really wants to quit.
 */
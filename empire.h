@@ -66,7 +66,8 @@ typedef long count_t; /* for iterating over or counting board locations */
 #define NUM_OBJECTS 9       /* number of defined objects */
 #define NOPIECE ((char)255) /* a 'null' piece */
 
-#define LIST_SIZE 5000 /* max number of pieces on board */
+#define DEF_LIST_SIZE 5000 /* default max number of pieces on board */
+#define MAX_THREADS 64 /* most threads planning the computer's moves */
 
 typedef struct city_info {
   loc_t loc;              /* location of city */
@@ -123,6 +124,7 @@ typedef struct piece_info {
   link_t piece_link;        /* linked list of pieces of this type */
   link_t loc_link;          /* linked list of pieces at a location */
   link_t cargo_link;        /* linked list of cargo pieces */
+  link_t block_link;        /* linked list of pieces of this type in block */
   int owner;                /* owner of piece */
   int type;                 /* type of piece */
   loc_t loc;                /* location of piece */
@@ -158,6 +160,19 @@ Macros to link and unlink an object from a doubly linked list.
     obj->list.prev = NULL;                                          \
   }
 
+/*
+The board is divided into square blocks, and the pieces of each owner
+and type are also listed by block, so we can find the pieces near a
+location without looking at all of them.  See object.c.
+*/
+
+#define BLOCK_SIZE 8 /* rows and columns of cells in a block */
+#define BLOCK_ROWS ((MAP_HEIGHT + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define BLOCK_COLS ((MAP_WIDTH + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define NUM_BLOCKS (BLOCK_ROWS * BLOCK_COLS)
+#define loc_block(loc) \
+  ((int)(loc_row(loc) / BLOCK_SIZE * BLOCK_COLS + loc_col(loc) / BLOCK_SIZE))
+
 /* macros to set map and list of an object */
 #define MAP(owner) ((owner) == USER ? user_map : comp_map)
 #define LIST(owner) ((owner) == USER ? user_obj : comp_obj)
@@ -200,37 +215,101 @@ it tells whether or not a square is on the board.
 the computer's view of the world.
 
 As of the 1.7 version, MAP_WIDTH and MAP_HEIGHT are now free paramaters.
-You can change them and the code will adjust properly.
+They are now chosen when the program starts (see main.c), along with
+NUM_CITY and LIST_SIZE, and every map is allocated to fit.
 */
 
-#define MAP_WIDTH 100
-#define MAP_HEIGHT 60
-#define MAP_SIZE (MAP_WIDTH * MAP_HEIGHT)
+#define DEF_MAP_WIDTH 100
+#define DEF_MAP_HEIGHT 60
+#define MIN_MAP_WIDTH 20 /* smallest map we will play on */
+#define MIN_MAP_HEIGHT 12
+#define MAX_MAP_WIDTH 1000 /* locations print as row and 3-digit column */
+#define MAX_MAP_HEIGHT 1000
 
 /* #define NUM_CITY 70 */
 /* #define NUM_CITY (MAP_SIZE / 85) */
-#define NUM_CITY ((100 * (MAP_WIDTH + MAP_HEIGHT)) / 228)
+#define DEF_NUM_CITY(width, height) ((100 * ((width) + (height))) / 228)
 
 typedef struct real_map { /* a cell of the actual map */
   char contents;          /* MAP_LAND, MAP_SEA, or MAP_CITY */
   bool on_board;          /* TRUE iff on the board */
+  uchar features;         /* F_SHORE, F_AT_SEA */
   city_info_t *cityp;     /* ptr to city at this location */
   piece_info_t *objp;     /* list of objects at this location */
 } real_map_t;
 
+/*
+Features of the real map, found once when the map is made (see
+rmap_find_features).  The map never changes after that, so they are
+saved with it.
+*/
+
+#define F_SHORE 0x01  /* a neighbor on the board is water */
+#define F_AT_SEA 0x02 /* water, and no neighbor on the board is not */
+
 typedef struct view_map { /* a cell of one player's world view */
   char contents;          /* MAP_LAND, MAP_SEA, MAP_CITY, 'A', 'a', etc */
   long seen;              /* date when last updated */
 } view_map_t;
 
-/* Define information we maintain for a pathmap. */
+/*
+Define information we maintain for a pathmap.
+
+The searches touch a few fields of many cells, so each field is kept
+in an array of its own, in the smallest type that holds it.  Costs
+are small enough to fit in 16 bits.
+
+A path map is never cleared between searches.  Instead, each search
+is given a new generation number, and each cell records the generation
+of the search that last touched it.  A cell whose stamp is not that
+of the map's current search lies outside the perimeter:  its cost is
+INFINITY and its terrain is T_UNKNOWN.  Path maps must start out
+zeroed, so they should not be automatic variables.  When a map runs
+out of generations, its stamps are cleared and it starts again.
+
+The cells on the edge of the board are sentinels.  Whenever the stamps
+of a path map are cleared, each of them is stamped with PMAP_EDGE,
+which is later than any search, so they always appear to have been
+reached already, with a cost of INFINITY and a terrain of T_UNKNOWN.
+A search therefore never expands into them, and need not test
+'on_board'.
+
+Costs too large to store are recorded in the incremental cost.  A cell
+with an incremental cost of PMAP_FAR was found to be unreachable from a
+cell whose cost is stored, and costs INFINITY/2 more than that cell.  A
+cell with an incremental cost of PMAP_NONE costs INFINITY.
+*/
 
 typedef struct {
-  int cost;     /* total cost to get here */
-  int inc_cost; /* incremental cost to get here */
-  char terrain; /* T_LAND, T_WATER, T_UNKNOWN, T_PATH */
+  unsigned short *cost;  /* total cost to get here */
+  uchar *inc_cost;       /* incremental cost to get here */
+  uchar *terrain;        /* T_LAND, T_WATER, T_UNKNOWN, T_PATH */
+  unsigned short *stamp; /* generation that last touched a cell */
+  unsigned short gen;    /* generation of the current search */
 } path_map_t;
 
+#define PMAP_EDGE 0xffff /* stamp of cells on the edge of the board */
+#define PMAP_FAR 0xff    /* inc_cost of a cell that cannot be reached */
+#define PMAP_NONE 0xfe   /* inc_cost of a cell with no cost at all */
+
+/* true iff a cell was touched by the map's current search */
+#define pmap_live(pmap, loc) ((pmap)->stamp[loc] >= (pmap)->gen)
+
+#define pmap_cost(pmap, loc)                                \
+  (!pmap_live(pmap, loc) || (pmap)->inc_cost[loc] == PMAP_NONE \
+       ? INFINITY                                           \
+       : (pmap)->inc_cost[loc] == PMAP_FAR                  \
+             ? (pmap)->cost[loc] + INFINITY / 2             \
+             : (int)(pmap)->cost[loc])
+#define pmap_terrain(pmap, loc) \
+  (pmap_live(pmap, loc) ? (pmap)->terrain[loc] : T_UNKNOWN)
+
+/* cost of the cells a live cell is reached from */
+#define pmap_pred_cost(pmap, loc)                 \
+  ((pmap)->inc_cost[loc] >= PMAP_NONE             \
+       ? (int)(pmap)->cost[loc]                   \
+       : (pmap)->cost[loc] - (pmap)->inc_cost[loc])
+
 #define T_UNKNOWN 0
 #define T_PATH 1
 #define T_LAND 2
@@ -263,6 +342,8 @@ typedef struct {
   char city_owner;  /* char that represents home city */
   char *objectives; /* list of objectives */
   int weights[11];  /* weight of each objective */
+  bool compiled;    /* true iff 'cost' has been built from the above */
+  int cost[256];    /* weight of each vmap char, INFINITY if not objective */
 } move_info_t;
 
 /* special weights */
@@ -271,10 +352,25 @@ typedef struct {
 /* List of cells in the perimeter of our searching for a path. */
 
 typedef struct {
-  long len;            /* number of items in list */
-  long list[MAP_SIZE]; /* list of locations */
+  long len;   /* number of items in list */
+  long *list; /* list of locations, MAP_SIZE long */
 } perimeter_t;
 
+/* Counts of the work done by the path routines, for debugging. */
+
+#define NUM_EXPAND_KERNELS 6
+
+typedef struct {
+  long mark_calls; /* calls to vmap_mark_path */
+  long mark_cells; /* cells they marked as on a path */
+  long mark_most;  /* most cells marked by a single call */
+  long expand_cells[NUM_EXPAND_KERNELS]; /* cells expanded by each kernel */
+  long expand_ticks[NUM_EXPAND_KERNELS]; /* clock ticks spent in each */
+  long skipped;    /* searches skipped with nothing to find */
+  long plans_made; /* load searches planned ahead of a move */
+  long plans_used; /* and those still good when the army moved */
+} path_stats_t;
+
 enum win_t { no_win, wipeout_win, ratio_win };
 
 #define MAP_LAND '+'
@@ -15,12 +15,25 @@ int WATER_RATIO;   /* percentage of map that is water */
 int MIN_CITY_DIST; /* cities must be at least this far apart */
 int delay_time;
 int save_interval; /* turns between autosaves */
+int MAP_WIDTH;     /* columns in map */
+int MAP_HEIGHT;    /* rows in map */
+int MAP_SIZE;      /* cells in map */
+int NUM_CITY;      /* number of cities */
+int LIST_SIZE;     /* max number of pieces on board */
+int plan_threads;  /* threads planning the computer's moves */
 
-real_map_t map[MAP_SIZE];      /* the way the world really looks */
-view_map_t comp_map[MAP_SIZE]; /* computer's view of the world */
-view_map_t user_map[MAP_SIZE]; /* user's view of the world */
+/* The maps and lists below are allocated by alloc_game(). */
 
-city_info_t city[NUM_CITY]; /* city information */
+real_map_t *map;      /* the way the world really looks */
+view_map_t *comp_map; /* computer's view of the world */
+view_map_t *user_map; /* user's view of the world */
+
+/* row, column and sector of each location; see init_loc_tables() */
+short *loc_rows;
+short *loc_cols;
+uchar *loc_sectors;
+
+city_info_t *city; /* city information */
 
 /*
 There is one array to hold all allocated objects no matter who
@@ -31,7 +44,7 @@ a list corresponding to the type of object and its owner.
 piece_info_t *free_list;             /* index to free items in object list */
 piece_info_t *user_obj[NUM_OBJECTS]; /* indices to user lists */
 piece_info_t *comp_obj[NUM_OBJECTS]; /* indices to computer lists */
-piece_info_t object[LIST_SIZE];      /* object list */
+piece_info_t *object;                /* object list */
 
 /* Display information. */
 int lines; /* lines on screen */
@@ -62,6 +75,8 @@ extern move_info_t user_fighter;
 extern move_info_t user_ship;
 extern move_info_t user_ship_repair;
 
+extern char *expand_kernel_names[];
+
 extern char *help_cmd[];
 extern char *help_edit[];
 extern char *help_user[];
@@ -83,21 +98,21 @@ bool save_movie;      /* true iff we should save movie screens */
 int user_score;       /* "score" for user and computer */
 int comp_score;
 char *savefile;
+path_stats_t path_stats; /* work done by the path routines */
 
 /* Screen updating macros */
 #define display_loc_u(loc) display_loc(USER, user_map, loc)
 #define display_loc_c(loc) display_loc(COMP, comp_map, loc)
 #define print_sector_u(sector) print_sector(USER, user_map, sector)
 #define print_sector_c(sector) print_sector(COMP, comp_map, sector)
-#define loc_row(loc) ((loc) / MAP_WIDTH)
-#define loc_col(loc) ((loc) % MAP_WIDTH)
+#define loc_row(loc) (loc_rows[loc])
+#define loc_col(loc) (loc_cols[loc])
 #define row_col_loc(row, col) ((long)((row)*MAP_WIDTH + (col)))
 #define sector_row(sector) ((sector) % SECTOR_ROWS)
 #define sector_col(sector) ((sector) / SECTOR_ROWS)
 #define row_col_sector(row, col) ((int)((col)*SECTOR_ROWS + (row)))
 
-#define loc_sector(loc) \
-  row_col_sector(loc_row(loc) / ROWS_PER_SECTOR, loc_col(loc) / COLS_PER_SECTOR)
+#define loc_sector(loc) (loc_sectors[loc])
 
 #define sector_loc(sector)                                                \
   row_col_loc(sector_row(sector) * ROWS_PER_SECTOR + ROWS_PER_SECTOR / 2, \
@@ -115,31 +130,55 @@ void edit(long edit_cursor);
 /* map routines */
 void vmap_cont(int *cont_map, view_map_t *vmap, long loc, char bad_terrain);
 void rmap_cont(int *cont_map, long loc, char bad_terrain);
+int rmap_cont_all(int *cont_map, scan_counts_t *counts, char bad_terrain);
 void vmap_mark_up_cont(int *cont_map, view_map_t *vmap, long loc,
                        char bad_terrain);
 scan_counts_t vmap_cont_scan(int *cont_map, view_map_t *vmap);
 scan_counts_t rmap_cont_scan(int *cont_map);
 bool map_cont_edge(int *cont_map, long loc);
-long vmap_find_aobj(path_map_t path_map[], view_map_t *vmap, long loc,
+int vmap_cont_label(view_map_t *vmap, long loc, char bad_terrain);
+scan_counts_t vmap_cont_counts(view_map_t *vmap, long loc, char bad_terrain);
+void vmap_forget_conts(void);
+long vmap_cont_version(view_map_t *vmap);
+int vmap_cont_all(int *cont_map, scan_counts_t *counts, view_map_t *vmap,
+                  char bad_terrain);
+long vmap_terrain(view_map_t *vmap);
+void vmap_set_terrain(view_map_t *vmap, long terrain);
+void vmap_copy(view_map_t *xmap, view_map_t *vmap);
+void vmap_overlay(view_map_t *xmap, view_map_t *vmap);
+void vmap_watch(view_map_t *vmap, perimeter_t *list);
+void vmap_set_contents(view_map_t *xmap, long loc, int contents);
+long vmap_census(view_map_t *vmap, int contents);
+long vmap_basin_count(view_map_t *vmap, int owner, long loc, char *chars);
+int vmap_crossing(view_map_t *vmap, int owner, long loc, char *targets);
+long vmap_find_aobj(path_map_t *path_map, view_map_t *vmap, long loc,
                     move_info_t *move_info);
-long vmap_find_wobj(path_map_t path_map[], view_map_t *vmap, long loc,
+long vmap_find_wobj(path_map_t *path_map, view_map_t *vmap, long loc,
                     move_info_t *move_info);
-long vmap_find_lobj(path_map_t path_map[], view_map_t *vmap, long loc,
+long vmap_find_lobj(path_map_t *path_map, view_map_t *vmap, long loc,
                     move_info_t *move_info);
-long vmap_find_lwobj(path_map_t path_map[], view_map_t *vmap, long loc,
+long vmap_find_lwobj(path_map_t *path_map, view_map_t *vmap, long loc,
                      move_info_t *move_info, int beat_cost);
-long vmap_find_wlobj(path_map_t path_map[], view_map_t *vmap, long loc,
+long vmap_find_wlobj(path_map_t *path_map, view_map_t *vmap, long loc,
                      move_info_t *move_info);
-long vmap_find_dest(path_map_t path_map[], view_map_t vmap[], long cur_loc,
+void vmap_prepare(move_info_t *move_info);
+long vmap_plan_lobj(path_map_t *path_map, view_map_t *vmap, long loc,
+                    move_info_t *move_info);
+long vmap_plan_lwobj(path_map_t *path_map, view_map_t *vmap, long loc,
+                     move_info_t *move_info, int beat_cost, int *cost);
+long vmap_find_dest(path_map_t *path_map, view_map_t vmap[], long cur_loc,
                     long dest_loc, int owner, int terrain);
-void vmap_prune_explore_locs(view_map_t *vmap);
+void vmap_prune_explore_locs(view_map_t *xmap, view_map_t *vmap);
+void vmap_changed(view_map_t *vmap, long loc, int old_contents);
+void vmap_forget_fields(void);
 void vmap_mark_path(path_map_t *path_map, view_map_t *vmap, long dest);
-void vmap_mark_adjacent(path_map_t path_map[], long loc);
-void vmap_mark_near_path(path_map_t path_map[], long loc);
-long vmap_find_dir(path_map_t path_map[], view_map_t *vmap, long loc,
+void vmap_mark_adjacent(path_map_t *path_map, long loc);
+void vmap_mark_near_path(path_map_t *path_map, long loc);
+long vmap_find_dir(path_map_t *path_map, view_map_t *vmap, long loc,
                    char *terrain, char *adjchar);
 int vmap_count_adjacent(view_map_t *vmap, long loc, char *adj_char);
 bool vmap_shore(view_map_t *vmap, long loc);
+void rmap_find_features(void);
 bool rmap_shore(long loc);
 bool vmap_at_sea(view_map_t *vmap, long loc);
 bool rmap_at_sea(long loc);
@@ -170,7 +209,8 @@ void close_disp(void);
 void pos_str(int row, int col, char *str, ...);
 int direction();
 
-void init_game(void); /* game routines */
+void alloc_game(void); /* game routines */
+void init_game(void);
 void save_game(void);
 int restore_game(void);
 void save_movie_screen(void);
@@ -186,10 +226,18 @@ bool getyn(char *message);
 int get_range(char *message, int low, int high);
 
 void rndini(void); /* math routines */
+void init_loc_tables(void);
 long irand(long high);
 int dist(long a, long b);
 int isqrt(int n);
 
+void alloc_paths(void); /* storage for the other modules */
+void alloc_comp(void);
+void alloc_user(void);
+void alloc_check(void);
+void alloc_pmap(path_map_t *pmap);
+void alloc_perimeter(perimeter_t *perim);
+
 int find_nearest_city(long loc, int owner, long *city_loc);
 city_info_t *find_city(long loc); /* object routines */
 piece_info_t *find_obj(int type, long loc);
@@ -210,6 +258,12 @@ void describe_obj(piece_info_t *obj);
 void scan(view_map_t vmap[], long loc);
 void scan_sat(view_map_t *vmap, long loc);
 void set_prod(city_info_t *cityp);
+void alloc_index(void);
+void clear_index(void);
+void index_piece(piece_info_t *obj);
+piece_info_t *block_pieces(int owner, int type, int block);
+int count_pieces(int owner, int type);
+int count_near(int owner, int type, loc_t loc, int radius, long func);
 
 /* terminal routines */
 void pdebug(char *s, ...);
@@ -228,6 +282,7 @@ void ksend(char *fmt, ...);
 
 /* utility routines */
 void ttinit(void);
+void *xalloc(long count, long size);
 void assert(char *expression, char *file, int line);
 void empend(void);
 char upper(char c);
@@ -18,8 +18,7 @@ game.c -- Routines to initialize, save, and restore a game.
 
 count_t remove_land(loc_t loc, count_t num_land);
 bool select_cities(void);
-bool find_next(loc_t *mapi);
-bool good_cont(loc_t mapi);
+bool good_cont(int cont);
 bool xread(FILE *f, char *buf, int size);
 bool xwrite(FILE *f, char *buf, int size);
 void stat_display(char *mbuf, int round);
@@ -54,11 +53,14 @@ void init_game(void) {
     comp_map[i].contents = ' ';
     comp_map[i].seen = 0;
   }
+  vmap_forget_fields();
+  vmap_forget_conts();
   for (i = 0; i < NUM_OBJECTS; i++) {
     user_obj[i] = NULL;
     comp_obj[i] = NULL;
   }
   free_list = NULL;                 /* nothing free yet */
+  clear_index();
   for (i = 0; i < LIST_SIZE; i++) { /* for each object */
     piece_info_t *obj = &(object[i]);
     obj->hits = 0; /* mark object as dead */
@@ -73,6 +75,7 @@ void init_game(void) {
       if (map[i].contents == MAP_CITY) map[i].contents = MAP_LAND; /* land */
     }
     place_cities();           /* place cities on map */
+    rmap_find_features();     /* shore and sea cells */
   } while (!select_cities()); /* choose a city for each player */
 }
 
@@ -90,8 +93,7 @@ at program start up.
 
 #define MAX_HEIGHT 999 /* highest height */
 
-/* these arrays give some compilers problems when they are automatic */
-static int height[2][MAP_SIZE];
+static int *height[2]; /* MAP_SIZE + 1 long; make_map() counts one extra */
 static int height_count[MAX_HEIGHT + 1];
 
 void make_map(void) {
@@ -162,8 +164,7 @@ list until all the cities are placed.  After each choice of a land cell
 for a city, we remove land cells which are too close to the city.
 */
 
-/* avoid compiler problems with large automatic arrays */
-static loc_t land[MAP_SIZE];
+static loc_t *land; /* land cells a city may be placed on */
 
 void place_cities(void) {
   count_t regen_land();
@@ -272,10 +273,10 @@ making sure the cities are not the same.
 
 #define MAX_CONT 10 /* most continents we will allow */
 
-typedef struct cont {           /* a continent */
-  long value;                   /* value of continent */
-  int ncity;                    /* number of cities */
-  city_info_t *cityp[NUM_CITY]; /* pointer to city */
+typedef struct cont {  /* a continent */
+  long value;          /* value of continent */
+  int ncity;           /* number of cities */
+  city_info_t **cityp; /* pointer to each city, NUM_CITY long */
 } cont_t;
 
 typedef struct pair {
@@ -284,7 +285,8 @@ typedef struct pair {
   int comp_cont; /* index to computer continent */
 } pair_t;
 
-static int marked[MAP_SIZE];      /* list of examine cells */
+static int *cont_map;             /* continent of each cell */
+static scan_counts_t *cont_counts; /* what is on each */
 static int ncont;                 /* number of continents */
 static cont_t cont_tab[MAX_CONT]; /* list of good continenets */
 static int rank_tab[MAX_CONT];    /* indices to cont_tab in order of rank */
@@ -341,34 +343,16 @@ city.  We rank the continents.
 */
 
 void find_cont(void) {
-  loc_t i;
-  loc_t mapi;
-
-  for (i = 0; i < MAP_SIZE; i++) marked[i] = 0; /* nothing marked yet */
-
-  ncont = 0; /* no continents found yet */
-  mapi = 0;
-
-  while (ncont < MAX_CONT)
-    if (!find_next(&mapi)) return; /* all found */
-}
-
-/*
-Find the next continent and insert it in the rank table.
-If there are no more continents, we return false.
-*/
-
-bool find_next(loc_t *mapi) {
+  int cont, nmapped;
   count_t i;
   long val;
 
-  for (;;) {
-    if (*mapi >= MAP_SIZE) return (false);
+  nmapped = rmap_cont_all(cont_map, cont_counts, MAP_SEA);
+  ncont = 0; /* no continents found yet */
 
-    if (!map[*mapi].on_board || marked[*mapi] || map[*mapi].contents == MAP_SEA)
-      *mapi += 1;
-    else if (good_cont(*mapi)) {
-      rank_tab[ncont] = ncont; /* insert cont in rank tab */
+  for (cont = 1; cont <= nmapped && ncont < MAX_CONT; cont++)
+    if (good_cont(cont)) { /* insert it in the rank table */
+      rank_tab[ncont] = ncont;
       val = cont_tab[ncont].value;
 
       for (i = ncont; i > 0; i--) { /* bubble up new rank */
@@ -379,29 +363,32 @@ bool find_next(loc_t *mapi) {
           break;
       }
       ncont++; /* count continents */
-      return (true);
     }
-  }
 }
 
 /*
-Map out the current continent.  We mark every piece of land on the continent,
-count the cities, shore cities, and land area of the continent.  If the
-continent contains 2 cities and a shore city, we set the value of the
-continent and return true.  Otherwise we return false.
+Look over a continent.  We count the cities and shore cities, and
+list the cities.  If the continent contains 2 cities and a shore
+city, we set the value of the continent and return true.  Otherwise
+we return false.
 */
 
-static count_t ncity, nland, nshore;
-static void mark_cont(loc_t);
-
-bool good_cont(loc_t mapi) {
+bool good_cont(int cont) {
   long val;
+  count_t i, ncity, nland, nshore;
+
+  if (cont_counts[cont].unowned_cities < 2) return (false);
 
   ncity = 0; /* nothing seen yet */
-  nland = 0;
+  nland = cont_counts[cont].size;
   nshore = 0;
 
-  mark_cont(mapi);
+  for (i = 0; i < NUM_CITY; i++)
+    if (cont_map[city[i].loc] == cont) {
+      cont_tab[ncont].cityp[ncity] = &city[i];
+      ncity++;
+      if (rmap_shore(city[i].loc)) nshore++;
+    }
 
   if (nshore < 1 || ncity < 2) return (false);
 
@@ -422,32 +409,6 @@ bool good_cont(loc_t mapi) {
   return (true);
 }
 
-/*
-Mark a continent.  This recursive algorithm marks the current square
-and counts it if it is land or city.  If it is city, we also check
-to see if it is a shore city, and we install it in the list of
-cities for the continent.  We then examine each surrounding cell.
-*/
-
-static void mark_cont(loc_t mapi) {
-  int i;
-
-  if (marked[mapi] || map[mapi].contents == MAP_SEA || !map[mapi].on_board)
-    return;
-
-  marked[mapi] = 1; /* mark this cell seen */
-  nland++;          /* count land on continent */
-
-  if (map[mapi].contents == MAP_CITY) { /* a city? */
-    cont_tab[ncont].cityp[ncity] = map[mapi].cityp;
-    ncity++;
-    if (rmap_shore(mapi)) nshore++;
-  }
-
-  for (i = 0; i < 8; i++) /* look at surrounding squares */
-    mark_cont(mapi + dir_offset[i]);
-}
-
 /*
 Create a list of pairs of continents in a ranked order.  The first
 element in the list is the pair which is easiest for the user to
@@ -486,9 +447,9 @@ to ask the user for a file name.  If we cannot save the game, we will
 tell the user why.
 */
 
-/* macro to save typing; write an array, return if it fails */
-#define wbuf(buf) \
-  if (!xwrite(f, (char *)buf, sizeof(buf))) return
+/* macro to save typing; write an array of 'n' items, return if it fails */
+#define wbuf(buf, n) \
+  if (!xwrite(f, (char *)buf, (n) * sizeof(*(buf)))) return
 #define wval(val) \
   if (!xwrite(f, (char *)&val, sizeof(val))) return
 
@@ -500,13 +461,17 @@ void save_game(void) {
     perror("Cannot save saved game");
     return;
   }
-  wbuf(map);
-  wbuf(comp_map);
-  wbuf(user_map);
-  wbuf(city);
-  wbuf(object);
-  wbuf(user_obj);
-  wbuf(comp_obj);
+  wval(MAP_WIDTH); /* the size of everything else */
+  wval(MAP_HEIGHT);
+  wval(NUM_CITY);
+  wval(LIST_SIZE);
+  wbuf(map, MAP_SIZE);
+  wbuf(comp_map, MAP_SIZE);
+  wbuf(user_map, MAP_SIZE);
+  wbuf(city, NUM_CITY);
+  wbuf(object, LIST_SIZE);
+  wbuf(user_obj, NUM_OBJECTS);
+  wbuf(comp_obj, NUM_OBJECTS);
   wval(free_list);
   wval(date);
   wval(automove);
@@ -526,8 +491,8 @@ Recover a saved game from emp_save.dat.
 We return true if we succeed, otherwise false.
 */
 
-#define rbuf(buf) \
-  if (!xread(f, (char *)buf, sizeof(buf))) return (false);
+#define rbuf(buf, n) \
+  if (!xread(f, (char *)buf, (n) * sizeof(*(buf)))) return (false);
 #define rval(val) \
   if (!xread(f, (char *)&val, sizeof(val))) return (false);
 
@@ -536,6 +501,7 @@ int restore_game(void) {
 
   FILE *f; /* file to save game in */
   long i;
+  int width, height, ncity, list_size; /* size of saved game */
   piece_info_t **list;
   piece_info_t *obj;
 
@@ -544,13 +510,26 @@ int restore_game(void) {
     perror("Cannot open saved game");
     return (false);
   }
-  rbuf(map);
-  rbuf(comp_map);
-  rbuf(user_map);
-  rbuf(city);
-  rbuf(object);
-  rbuf(user_obj);
-  rbuf(comp_obj);
+  rval(width);
+  rval(height);
+  rval(ncity);
+  rval(list_size);
+  if (width != MAP_WIDTH || height != MAP_HEIGHT || ncity != NUM_CITY ||
+      list_size != LIST_SIZE) {
+    (void)fclose(f);
+    topmsg(3, "Saved game is for a %dx%d map with %d cities and %d pieces.",
+           width, height, ncity, list_size);
+    return (false);
+  }
+  rbuf(map, MAP_SIZE);
+  rbuf(comp_map, MAP_SIZE);
+  rbuf(user_map, MAP_SIZE);
+  vmap_forget_fields();
+  vmap_forget_conts();
+  rbuf(city, NUM_CITY);
+  rbuf(object, LIST_SIZE);
+  rbuf(user_obj, NUM_OBJECTS);
+  rbuf(comp_obj, NUM_OBJECTS);
   rval(free_list);
   rval(date);
   rval(automove);
@@ -576,6 +555,8 @@ int restore_game(void) {
     object[i].cargo_link.prev = NULL;
     object[i].piece_link.next = NULL;
     object[i].piece_link.prev = NULL;
+    object[i].block_link.next = NULL;
+    object[i].block_link.prev = NULL;
     object[i].ship = NULL;
     object[i].cargo = NULL;
   }
@@ -583,6 +564,7 @@ int restore_game(void) {
     comp_obj[i] = NULL;
     user_obj[i] = NULL;
   }
+  clear_index();
   /* put cities on map */
   for (i = 0; i < NUM_CITY; i++) map[city[i].loc].cityp = &(city[i]);
 
@@ -595,6 +577,7 @@ int restore_game(void) {
       list = LIST(object[i].owner);
       LINK(list[object[i].type], obj, piece_link);
       LINK(map[object[i].loc].objp, obj, loc_link);
+      index_piece(obj);
     }
   }
 
@@ -689,7 +672,7 @@ computer's screen.  This information is appended to 'empmovie.dat'.
 */
 
 extern char city_char[];
-static char mapbuf[MAP_SIZE];
+static char *mapbuf;
 
 void save_movie_screen(void) {
   FILE *f; /* file to save game in */
@@ -716,7 +699,7 @@ void save_movie_screen(void) {
         mapbuf[i] = tolower(piece_attr[p->type].sname);
     }
   }
-  wbuf(mapbuf);
+  wbuf(mapbuf, MAP_SIZE);
   (void)fclose(f);
 }
 
@@ -741,7 +724,7 @@ void replay_movie(void) {
   round = 0;
   clear_screen();
   for (;;) {
-    if (fread((char *)mapbuf, 1, sizeof(mapbuf), f) != sizeof(mapbuf)) break;
+    if (fread((char *)mapbuf, 1, MAP_SIZE, f) != MAP_SIZE) break;
     round += 1;
 
     stat_display(mapbuf, round);
@@ -804,4 +787,38 @@ void stat_display(char *mbuf, int round) {
   pos_str(0, 0, "Round %3d", (round + 1) / 2);
 }
 
+/*
+Allocate the maps and lists of the game, now that we know how big
+the map is, along with the storage of the other modules.
+*/
+
+void alloc_game(void) {
+  int i;
+
+  map = xalloc(MAP_SIZE, sizeof(real_map_t));
+  comp_map = xalloc(MAP_SIZE, sizeof(view_map_t));
+  user_map = xalloc(MAP_SIZE, sizeof(view_map_t));
+  loc_rows = xalloc(MAP_SIZE, sizeof(short));
+  loc_cols = xalloc(MAP_SIZE, sizeof(short));
+  loc_sectors = xalloc(MAP_SIZE, sizeof(uchar));
+  city = xalloc(NUM_CITY, sizeof(city_info_t));
+  object = xalloc(LIST_SIZE, sizeof(piece_info_t));
+  init_loc_tables();
+
+  height[0] = xalloc(MAP_SIZE + 1, sizeof(int));
+  height[1] = xalloc(MAP_SIZE + 1, sizeof(int));
+  land = xalloc(MAP_SIZE, sizeof(loc_t));
+  cont_map = xalloc(MAP_SIZE, sizeof(int));
+  cont_counts = xalloc(MAP_SIZE + 1, sizeof(scan_counts_t));
+  for (i = 0; i < MAX_CONT; i++)
+    cont_tab[i].cityp = xalloc(NUM_CITY, sizeof(city_info_t *));
+  mapbuf = xalloc(MAP_SIZE, sizeof(char));
+
+  alloc_paths();
+  alloc_comp();
+  alloc_user();
+  alloc_check();
+  alloc_index();
+}
+
 /* end */
@@ -21,6 +21,21 @@ options:
 
     -S saveinterval: sets turn interval between saves.
                default is 10
+
+    -W width:  number of columns in the map.  Must be in the range
+               20..1000.  Default is 100.
+
+    -H height: number of rows in the map.  Must be in the range
+               12..1000.  Default is 60.
+
+    -c cities: number of cities.  Default depends on the size of the
+               map; it is 70 for the default map.
+
+    -p pieces: most pieces that may be on the board at once.  Default
+               is 5000.
+
+    -t threads: number of threads planning the computer's moves.  Must
+               be in the range 1..64.  Default is 1.
 */
 
 #include <stdio.h>
@@ -29,7 +44,7 @@ options:
 #include "empire.h"
 #include "extern.h"
 
-#define OPTFLAGS "w:s:d:S:f:"
+#define OPTFLAGS "w:s:d:S:f:W:H:c:p:t:"
 
 int main(argc, argv) int argc;
 char *argv[];
@@ -39,12 +54,18 @@ char *argv[];
   extern int optind;
   int errflg = 0;
   int wflg, sflg, dflg, Sflg;
+  int Wflg, Hflg, cflg, pflg, tflg;
   int land;
 
   wflg = 70; /* set defaults */
   sflg = 5;
   dflg = 2000;
   Sflg = 10;
+  Wflg = DEF_MAP_WIDTH;
+  Hflg = DEF_MAP_HEIGHT;
+  cflg = 0; /* chosen from the size of the map */
+  pflg = DEF_LIST_SIZE;
+  tflg = 1;
   savefile = "empsave.dat";
 
   /*
@@ -68,13 +89,30 @@ char *argv[];
       case 'f':
         savefile = optarg;
         break;
+      case 'W':
+        Wflg = atoi(optarg);
+        break;
+      case 'H':
+        Hflg = atoi(optarg);
+        break;
+      case 'c':
+        cflg = atoi(optarg);
+        break;
+      case 'p':
+        pflg = atoi(optarg);
+        break;
+      case 't':
+        tflg = atoi(optarg);
+        break;
       case '?': /* illegal option? */
         errflg++;
         break;
     }
   }
   if (errflg || (argc - optind) != 0) {
-    (void)printf("empire: usage: empire [-w water] [-s smooth] [-d delay]\n");
+    (void)printf(
+        "empire: usage: empire [-w water] [-s smooth] [-d delay] "
+        "[-W width] [-H height] [-c cities] [-p pieces] [-t threads]\n");
     exit(1);
   }
 
@@ -92,16 +130,53 @@ char *argv[];
     exit(1);
   }
 
+  if (Wflg < MIN_MAP_WIDTH || Wflg > MAX_MAP_WIDTH) {
+    (void)printf("empire: -W argument must be in the range %d..%d.\n",
+                 MIN_MAP_WIDTH, MAX_MAP_WIDTH);
+    exit(1);
+  }
+  if (Hflg < MIN_MAP_HEIGHT || Hflg > MAX_MAP_HEIGHT) {
+    (void)printf("empire: -H argument must be in the range %d..%d.\n",
+                 MIN_MAP_HEIGHT, MAX_MAP_HEIGHT);
+    exit(1);
+  }
+  /* leave at least two cells of land for each city */
+  land = (Wflg - 2) * (Hflg - 2) * (100 - wflg) / 100 / 2;
+  if (cflg == 0) {
+    cflg = DEF_NUM_CITY(Wflg, Hflg);
+    if (cflg > land) cflg = land;
+  }
+  if (cflg < 2 || cflg > land) {
+    (void)printf("empire: -c argument must be in the range 2..%d.\n", land);
+    exit(1);
+  }
+  if (pflg < 10 * cflg) { /* cities keep producing */
+    (void)printf("empire: -p argument must be at least %d.\n", 10 * cflg);
+    exit(1);
+  }
+  if (tflg < 1 || tflg > MAX_THREADS) {
+    (void)printf("empire: -t argument must be in the range 1..%d.\n",
+                 MAX_THREADS);
+    exit(1);
+  }
+
   SMOOTH = sflg;
   WATER_RATIO = wflg;
   delay_time = dflg;
   save_interval = Sflg;
+  MAP_WIDTH = Wflg;
+  MAP_HEIGHT = Hflg;
+  MAP_SIZE = MAP_WIDTH * MAP_HEIGHT;
+  NUM_CITY = cflg;
+  LIST_SIZE = pflg;
+  plan_threads = tflg;
 
   /* compute min distance between cities */
   land = MAP_SIZE * (100 - WATER_RATIO) / 100; /* available land */
   land /= NUM_CITY;                            /* land per city */
   MIN_CITY_DIST = isqrt(land);                 /* distance between cities */
 
-  empire(); /* call main routine */
+  alloc_game(); /* make room for a map this size */
+  empire();     /* call main routine */
   return (0);
 }
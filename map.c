@@ -12,7 +12,9 @@ This file contains routines for playing around with view_maps,
 real_maps, path_maps, and cont_maps.
 */
 
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "empire.h"
 #include "extern.h"
 
@@ -27,22 +29,174 @@ real_maps, path_maps, and cont_maps.
 static void expand_perimeter(path_map_t *, view_map_t *, move_info_t *,
                              perimeter_t *, int, int, int, int, perimeter_t *,
                              perimeter_t *);
-static void expand_prune(view_map_t *, path_map_t *, loc_t, int, perimeter_t *,
-                         int *);
 static int objective_cost(view_map_t *, move_info_t *, loc_t, int);
 static int terrain_type(path_map_t *, view_map_t *, move_info_t *, loc_t,
                         loc_t);
-static void start_perimeter(path_map_t *, perimeter_t *, loc_t, int);
+static void start_perimeter(path_map_t *, perimeter_t *, loc_t, int,
+                            move_info_t *);
+static void compile_move_info(move_info_t *);
+static void edge_path_map(path_map_t *);
 static void add_cell(path_map_t *, loc_t, perimeter_t *, int, int, int);
 static int vmap_count_path(path_map_t *, loc_t);
+static int count_adjacent(view_map_t *, loc_t, uchar *);
+static void make_adj_weights(uchar *, char *);
+static void mark_cell(path_map_t *, loc_t);
+static int push_path(path_map_t *, loc_t);
+static void forget_census(void);
+static void forget_basin_counts(view_map_t *);
+static void census_changed(view_map_t *, int, int);
+static void forget_predictions(void);
+static void predictions_changed(view_map_t *, loc_t, int, int);
+static void forget_overlays(void);
+static void overlays_changed(view_map_t *, loc_t);
+static void overlay_note(view_map_t *, loc_t);
+static void watch_changed(view_map_t *, loc_t);
 
 static perimeter_t p1; /* perimeter list for use as needed */
 static perimeter_t p2;
 static perimeter_t p3;
-static perimeter_t p4;
 
-static int best_cost; /* cost and location of best objective */
-static loc_t best_loc;
+/* each thread searching has its own; see vmap_plan_lobj() */
+static _Thread_local int best_cost; /* cost and location of best objective */
+static _Thread_local loc_t best_loc;
+static _Thread_local bool planning; /* true iff in a planning search */
+
+/*
+Distance fields.
+
+Every computer army looks for 'army_fight' objectives on 'comp_map'
+in turn, and every exploring user piece does much the same on
+'user_map'.  In between, the view map seldom changes in a way that
+matters to the search: most moves just shift a piece over terrain of
+the kind it is already shown on.  So for these two view maps we keep,
+for each set of objectives and terrain, a field giving the cost from
+every cell to the best objective.  A field is built by a single search
+outward from all of the objectives at once, and is thrown away when
+'update' tells us (through 'vmap_changed') that a cell has changed in
+a way that matters to it.
+
+With a field, a piece knows the cost of its best objective before it
+starts to search, and need only visit the cells whose cost so far plus
+their cost in the field equals that cost; that is, the cells on some
+best path.  Those cells receive the same costs as the full search gives
+them, which is all that 'vmap_mark_path' and 'vmap_find_dir' look at.
+Among objectives of equal cost, the one found first may differ.
+
+Objectives whose cost depends on the cost of reaching them (W_TT_BUILD)
+cannot go in a field; searches for them are done in full.
+*/
+
+#define NUM_FIELDS 8
+
+typedef struct {
+  view_map_t *vmap;       /* map field describes, or NULL if slot unused */
+  move_info_t *move_info; /* objectives and weights */
+  int expand;             /* terrain searches may cross */
+  bool valid;             /* false if the map has changed since built */
+  int searches;           /* searches since the map last changed */
+  int *cost;              /* cost from each cell to the best objective */
+} dist_field_t;
+
+#define SHOWS_TERRAIN(c) ((c) == MAP_LAND || (c) == MAP_SEA || (c) == ' ')
+
+static dist_field_t fields[NUM_FIELDS];
+static int next_field; /* slot to reuse when we need a new field */
+
+static int field_terrain(int, int, loc_t);
+static dist_field_t *find_field(view_map_t *, loc_t, move_info_t *, int);
+static void build_field(dist_field_t *);
+static loc_t field_find_obj(path_map_t *, view_map_t *, loc_t, move_info_t *,
+                            int, int, dist_field_t *);
+
+/*
+Sector graphs.
+
+A piece sent to a distant destination would have 'vmap_find_dest'
+search most of the map cell by cell.  Instead, for pieces that cross
+only land or only water, we divide the map into small square sectors
+and keep a graph of the ways between them.  Wherever the cells on both
+sides of a sector border can be crossed, each run of such cells gets
+an entrance at its middle, on each side of the border; cells that meet
+only at the corners of sectors get one too.  For each sector we record
+the cost of moving between each pair of its entrances without leaving
+the sector.
+
+Near its destination a piece searches cell by cell, but only within
+the sectors around the destination.  Farther away it searches over
+the entrances, and only the first leg of the path it finds, to the
+entrance by which it leaves its sector, is searched cell by cell.
+The path is not always a shortest one, but it is seldom much longer.
+
+Graphs are kept for 'comp_map' and 'user_map'.  When a cell changes
+between crossable and not, 'vmap_changed' marks the sectors whose
+entrances or costs may have changed, and they are brought up to date
+the next time the graph is used.
+*/
+
+#define PSECTOR_SIZE 10 /* rows and columns of cells in a sector */
+#define PSECTOR_ROWS ((MAP_HEIGHT + PSECTOR_SIZE - 1) / PSECTOR_SIZE)
+#define PSECTOR_COLS ((MAP_WIDTH + PSECTOR_SIZE - 1) / PSECTOR_SIZE)
+#define NUM_PSECTORS (PSECTOR_ROWS * PSECTOR_COLS)
+#define MAX_ENTRANCES 24 /* five runs on each side, and four corners */
+#define NUM_NODES (NUM_PSECTORS * MAX_ENTRANCES)
+#define NUM_GRAPHS 4     /* two view maps, two kinds of terrain */
+#define NO_WAY 0x7fff    /* cost between entrances with no way between */
+
+#define loc_psector(loc)                              \
+  ((int)(loc_row(loc) / PSECTOR_SIZE * PSECTOR_COLS + \
+         loc_col(loc) / PSECTOR_SIZE))
+
+typedef struct {
+  bool dirty;                               /* true if out of date */
+  int count;                                /* number of entrances */
+  loc_t entrance[MAX_ENTRANCES];            /* location of each entrance */
+  short cost[MAX_ENTRANCES][MAX_ENTRANCES]; /* cost between entrances */
+} psector_t;
+
+typedef struct {
+  view_map_t *vmap; /* map graph describes, or NULL if slot unused */
+  int terrain;      /* T_LAND or T_WATER */
+  int owner;        /* owner of cities that may be entered */
+  bool built;       /* false if every sector is out of date */
+  psector_t *sector;        /* NUM_PSECTORS long */
+  signed char *entrance_of; /* entrance at each cell, or -1 */
+} sector_graph_t;
+
+static sector_graph_t graphs[NUM_GRAPHS];
+
+/* a rectangle of cells that a search for a destination stays within */
+
+typedef struct {
+  int row0, col0; /* first row and column inside */
+  int row1, col1; /* last row and column inside */
+} box_t;
+
+#define IN_BOX(box, loc)                                         \
+  (loc_row(loc) >= (box)->row0 && loc_row(loc) <= (box)->row1 && \
+   loc_col(loc) >= (box)->col0 && loc_col(loc) <= (box)->col1)
+
+static sector_graph_t *find_graph(view_map_t *, int, int);
+static void sector_box(box_t *, int, int);
+static void sectors_changed(view_map_t *, loc_t, int, int);
+static loc_t sector_find_dest(sector_graph_t *, loc_t, loc_t, int);
+static loc_t search_dest(path_map_t *, view_map_t *, loc_t, loc_t, int, int,
+                         box_t *);
+static void expand_dest(path_map_t *, view_map_t *, move_info_t *, loc_t,
+                        loc_t, int, box_t *, perimeter_t *[]);
+
+/*
+A set of characters, such as the list of terrain a piece may enter.
+We build these from strings so that testing membership is a single
+lookup instead of a call to 'strchr'.
+*/
+
+typedef struct {
+  uchar bits[256 / 8];
+} char_set_t;
+
+#define IN_SET(set, c) ((set).bits[(uchar)(c) >> 3] & (1 << ((uchar)(c)&7)))
+
+static void make_char_set(char_set_t *, char *);
 
 /*
 Map out a continent.  We are given a location on the continent.
@@ -113,128 +267,1652 @@ By adjusting the value of
 or lakes.
 */
 
-static void rmap_mark_up_cont(int *cont_map, loc_t loc, char bad_terrain);
-
 void rmap_cont(int *cont_map, loc_t loc, char bad_terrain) {
+  static int *all_map;
+  static scan_counts_t *counts;
+  loc_t i;
+
+  if (all_map == NULL) {
+    all_map = xalloc(MAP_SIZE, sizeof(int));
+    counts = xalloc(MAP_SIZE + 1, sizeof(scan_counts_t));
+  }
   (void)memset((char *)cont_map, '\0', MAP_SIZE * sizeof(int));
-  rmap_mark_up_cont(cont_map, loc, bad_terrain);
+  (void)rmap_cont_all(all_map, counts, bad_terrain);
+
+  if (all_map[loc] == 0) return; /* off continent */
+  for (i = 0; i < MAP_SIZE; i++)
+    if (all_map[i] == all_map[loc]) cont_map[i] = 1;
 }
 
 /*
-Mark all squares of a continent and the squares that are adjacent
-to the continent which are on the board.  Our passed location is
-known to be either on the continent or adjacent to the continent.
+Map out every continent of the real map.  We set each cell of
+'cont_map' to the number of the continent the cell is on, counting
+from 1 in the order in which the continents are first met going
+down the map, or to 0 if the cell is not on a continent.  'counts[n]'
+is set to what rmap_cont_scan() would find on continent 'n'.  We
+return the number of continents.
+
+We go down the map a row at a time, joining each cell to the cells
+above and to the left of it that we have already seen.  Cells get
+temporary numbers, and we keep track of which numbers have been
+found to be the same continent in a union-find forest.  A last pass
+gives each cell the number of its continent.
+*/
+
+static int *cont_parent; /* union-find forest of cell numbers */
+
+static int cont_find(int n) {
+  while (cont_parent[n] != n) {
+    cont_parent[n] = cont_parent[cont_parent[n]]; /* halve path */
+    n = cont_parent[n];
+  }
+  return n;
+}
+
+int rmap_cont_all(int *cont_map, scan_counts_t *counts, char bad_terrain) {
+  int back[4] = {-1, -MAP_WIDTH - 1, -MAP_WIDTH, -MAP_WIDTH + 1};
+  loc_t loc, new_loc;
+  int i, n, m, ntemp, ncont;
+
+  ntemp = 0;
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    cont_map[loc] = 0;
+    if (!map[loc].on_board || map[loc].contents == bad_terrain) continue;
+
+    n = 0;
+    for (i = 0; i < 4; i++) { /* join cells already seen */
+      new_loc = loc + back[i];
+      if (new_loc < 0 || cont_map[new_loc] == 0) continue;
+
+      m = cont_find(cont_map[new_loc]);
+      if (n == 0)
+        n = m;
+      else if (m != n) { /* two continents meet; keep the older */
+        if (m < n) {
+          int t = m;
+          m = n;
+          n = t;
+        }
+        cont_parent[m] = n;
+        counts[n].size += counts[m].size;
+        counts[n].unowned_cities += counts[m].unowned_cities;
+      }
+    }
+    if (n == 0) { /* start a new continent */
+      n = ++ntemp;
+      cont_parent[n] = n;
+      (void)memset((char *)&counts[n], '\0', sizeof(scan_counts_t));
+    }
+    cont_map[loc] = n;
+    counts[n].size += 1;
+    if (map[loc].contents == MAP_CITY) counts[n].unowned_cities += 1;
+  }
+
+  /* number the continents in order, and move their counts there */
+  ncont = 0;
+  for (n = 1; n <= ntemp; n++)
+    if (cont_parent[n] == n) {
+      ncont += 1;
+      counts[ncont] = counts[n];
+      cont_parent[n] = -ncont;
+    }
+  for (loc = 0; loc < MAP_SIZE; loc++)
+    if (cont_map[loc]) {
+      for (n = cont_map[loc]; cont_parent[n] > 0; n = cont_parent[n])
+        ;
+      cont_map[loc] = -cont_parent[n];
+    }
+  return ncont;
+}
+
+/*
+Scan a continent recording items of interest on the continent.
+
+This could be done as we mark up the continent.
+*/
+
+#define COUNT(c, item) \
+  case c:              \
+    item += delta;     \
+    break
+
+/*
+Add 'delta' to the counts for one cell showing 'contents'.  The
+cell's size is left to the caller.
+*/
+
+static void count_cell(scan_counts_t *counts, int contents, loc_t loc,
+                       int delta) {
+  switch (contents) {
+    COUNT(' ', counts->unexplored);
+    COUNT('O', counts->user_cities);
+    COUNT('A', counts->user_objects[ARMY]);
+    COUNT('F', counts->user_objects[FIGHTER]);
+    COUNT('P', counts->user_objects[PATROL]);
+    COUNT('D', counts->user_objects[DESTROYER]);
+    COUNT('S', counts->user_objects[SUBMARINE]);
+    COUNT('T', counts->user_objects[TRANSPORT]);
+    COUNT('C', counts->user_objects[CARRIER]);
+    COUNT('B', counts->user_objects[BATTLESHIP]);
+    COUNT('X', counts->comp_cities);
+    COUNT('a', counts->comp_objects[ARMY]);
+    COUNT('f', counts->comp_objects[FIGHTER]);
+    COUNT('p', counts->comp_objects[PATROL]);
+    COUNT('d', counts->comp_objects[DESTROYER]);
+    COUNT('s', counts->comp_objects[SUBMARINE]);
+    COUNT('t', counts->comp_objects[TRANSPORT]);
+    COUNT('c', counts->comp_objects[CARRIER]);
+    COUNT('b', counts->comp_objects[BATTLESHIP]);
+    COUNT(MAP_CITY, counts->unowned_cities);
+    case MAP_LAND:
+      break;
+    case MAP_SEA:
+      break;
+    default: /* check for city underneath */
+      if (map[loc].contents == MAP_CITY) {
+        switch (map[loc].cityp->owner) {
+          COUNT(USER, counts->user_cities);
+          COUNT(COMP, counts->comp_cities);
+          COUNT(UNOWNED, counts->unowned_cities);
+        }
+      }
+  }
+}
+
+scan_counts_t vmap_cont_scan(int *cont_map, view_map_t *vmap) {
+  scan_counts_t counts;
+  count_t i;
+
+  (void)memset((char *)&counts, '\0', sizeof(scan_counts_t));
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    if (cont_map[i]) { /* cell on continent? */
+      counts.size += 1;
+      count_cell(&counts, vmap[i].contents, i, 1);
+    }
+  }
+  return counts;
+}
+
+/*
+Scan a real map as above.  Only the 'size' and 'unowned_cities'
+fields are valid.
+*/
+
+scan_counts_t rmap_cont_scan(int *cont_map) {
+  scan_counts_t counts;
+  count_t i;
+
+  (void)memset((char *)&counts, '\0', sizeof(scan_counts_t));
+
+  for (i = 0; i < MAP_SIZE; i++) {
+    if (cont_map[i]) { /* cell on continent? */
+      counts.size += 1;
+      if (map[i].contents == MAP_CITY) counts.unowned_cities += 1;
+    }
+  }
+  return counts;
+}
+
+/*
+Return true if a location is on the edge of a continent.
+*/
+
+bool map_cont_edge(int *cont_map, loc_t loc) {
+  loc_t i, j;
+
+  if (!cont_map[loc]) return false; /* not on continent */
+
+  FOR_ADJ(loc, j, i)
+  if (!cont_map[j]) return true; /* edge of continent */
+
+  return false;
+}
+
+/*
+Continent labels.  Rather than flooding a continent each time we
+want to know what is on it, we keep the continents of the computer's
+and user's view maps as sets in a union-find forest.  The root of
+each set holds the scan counts for its continent, which we keep up
+to date as update() changes the map:  a cell coming into view joins
+the continents around it, merging them if it touches more than one,
+and a piece moving about on a continent just adjusts its counts.
+
+As in vmap_cont(), a continent is its explored cells together with
+the unexplored cells next to them.  There is one labeling for land
+and one for water on each map;  each is built the first time it is
+asked for.
+*/
+
+#define NUM_LABELINGS 4
+
+typedef struct {
+  view_map_t *vmap;
+  char bad_terrain;
+  bool valid;
+  int *parent; /* parent in forest, or -1 if not on a continent */
+  int *next;   /* next cell of the same continent, or -1 */
+  int *last;   /* for a root: last cell of its continent */
+  int *cells;  /* for a root: explored cells on its continent */
+  scan_counts_t *counts; /* for a root: counts for its continent */
+} labeling_t;
+
+static labeling_t labelings[NUM_LABELINGS];
+static long *label_stamp; /* when an unexplored cell was counted */
+static long label_time;
+static long cont_changes[2]; /* see vmap_cont_version() */
+
+/* Return the labeling for a map and terrain, or NULL if there is none. */
+
+static labeling_t *find_labeling(view_map_t *vmap, char bad_terrain) {
+  labeling_t *lab;
+
+  if (vmap != comp_map && vmap != user_map) return NULL;
+  if (bad_terrain != MAP_LAND && bad_terrain != MAP_SEA) return NULL;
+
+  lab = &labelings[(vmap == user_map) * 2 + (bad_terrain == MAP_LAND)];
+  lab->vmap = vmap;
+  lab->bad_terrain = bad_terrain;
+  return lab;
+}
+
+/* Return true iff a cell is explored and part of a continent. */
+
+static bool cont_good(view_map_t *vmap, loc_t loc, char bad_terrain) {
+  char contents = vmap[loc].contents;
+  char terrain;
+
+  if (!map[loc].on_board || contents == ' ') return false;
+
+  if (contents == MAP_LAND || contents == MAP_SEA)
+    terrain = contents;
+  else
+    terrain = map[loc].contents;
+  return terrain != bad_terrain;
+}
+
+#define label_good(lab, loc) cont_good((lab)->vmap, loc, (lab)->bad_terrain)
+
+/* Return the root of the set holding a cell on a continent. */
+
+static int label_find(labeling_t *lab, loc_t loc) {
+  while (lab->parent[loc] != loc) {
+    lab->parent[loc] = lab->parent[lab->parent[loc]]; /* halve path */
+    loc = lab->parent[loc];
+  }
+  return loc;
+}
+
+/* Return true iff a cell is next to the continent with a given root. */
+
+static bool label_touches(labeling_t *lab, loc_t loc, int root) {
+  int i;
+  loc_t new_loc;
+
+  FOR_ADJ_ON(loc, new_loc, i)
+  if (lab->parent[new_loc] >= 0 && label_find(lab, new_loc) == root)
+    return true;
+  return false;
+}
+
+/* Add the counts for one continent into those of another. */
+
+static void add_counts(scan_counts_t *to, scan_counts_t *from) {
+  int i;
+
+  to->user_cities += from->user_cities;
+  to->comp_cities += from->comp_cities;
+  for (i = 0; i < NUM_OBJECTS; i++) {
+    to->user_objects[i] += from->user_objects[i];
+    to->comp_objects[i] += from->comp_objects[i];
+  }
+  to->size += from->size;
+  to->unowned_cities += from->unowned_cities;
+  to->unexplored += from->unexplored;
+}
+
+/*
+Merge the continents holding two cells.  We walk the smaller of the
+two, and uncount any unexplored cell it shares with the larger.
+*/
+
+static void label_union(labeling_t *lab, loc_t a, loc_t b) {
+  int ra, rb, shared;
+  int i;
+  loc_t m, new_loc;
+
+  ra = label_find(lab, a);
+  rb = label_find(lab, b);
+  if (ra == rb) return;
+  if (lab->cells[ra] < lab->cells[rb]) { /* walk the smaller */
+    ra = rb;
+    rb = label_find(lab, a);
+  }
+
+  label_time += 1;
+  shared = 0;
+  for (m = rb; m >= 0; m = lab->next[m]) {
+    FOR_ADJ_ON(m, new_loc, i) {
+      if (lab->vmap[new_loc].contents == ' ' &&
+          label_stamp[new_loc] != label_time) {
+        label_stamp[new_loc] = label_time;
+        if (label_touches(lab, new_loc, ra)) shared += 1;
+      }
+    }
+  }
+  add_counts(&lab->counts[ra], &lab->counts[rb]);
+  lab->counts[ra].size -= shared;
+  lab->counts[ra].unexplored -= shared;
+  lab->cells[ra] += lab->cells[rb];
+
+  lab->next[lab->last[ra]] = rb; /* append rb's cells */
+  lab->last[ra] = lab->last[rb];
+  lab->parent[rb] = ra;
+}
+
+/*
+Note that a cell has come into view.  It is no longer unexplored
+territory next to the continents around it, and if it is part of a
+continent, it joins them.
+*/
+
+static void label_reveal(labeling_t *lab, loc_t loc) {
+  int roots[8];
+  int nroots, root;
+  int i, k;
+  loc_t new_loc;
+  scan_counts_t *counts;
+
+  nroots = 0;
+  FOR_ADJ_ON(loc, new_loc, i) {
+    if (lab->parent[new_loc] < 0) continue;
+    root = label_find(lab, new_loc);
+    for (k = 0; k < nroots && roots[k] != root; k++)
+      ;
+    if (k == nroots) {
+      roots[nroots++] = root;
+      lab->counts[root].size -= 1;
+      lab->counts[root].unexplored -= 1;
+    }
+  }
+  if (!label_good(lab, loc)) return;
+
+  lab->parent[loc] = loc;
+  lab->next[loc] = -1;
+  lab->last[loc] = loc;
+  lab->cells[loc] = 1;
+  counts = &lab->counts[loc];
+  (void)memset((char *)counts, '\0', sizeof(scan_counts_t));
+  counts->size = 1;
+  count_cell(counts, lab->vmap[loc].contents, loc, 1);
+
+  FOR_ADJ_ON(loc, new_loc, i)
+  if (lab->vmap[new_loc].contents == ' ') {
+    counts->size += 1;
+    counts->unexplored += 1;
+  }
+  FOR_ADJ_ON(loc, new_loc, i)
+  if (lab->parent[new_loc] >= 0) label_union(lab, loc, new_loc);
+}
+
+/* Label every continent of a map from scratch. */
+
+static void label_build(labeling_t *lab) {
+  loc_t loc, m, new_loc;
+  int i, j, root;
+  perimeter_t *from, *to;
+  scan_counts_t *counts;
+
+  for (loc = 0; loc < MAP_SIZE; loc++) lab->parent[loc] = -1;
+
+  for (root = 0; root < MAP_SIZE; root++) {
+    if (lab->parent[root] >= 0 || !label_good(lab, root)) continue;
+
+    lab->parent[root] = root;
+    lab->last[root] = root;
+    lab->cells[root] = 0;
+    counts = &lab->counts[root];
+    (void)memset((char *)counts, '\0', sizeof(scan_counts_t));
+    label_time += 1;
+
+    from = &p1;
+    to = &p2;
+    from->len = 1;
+    from->list[0] = root;
+
+    while (from->len) {
+      to->len = 0;
+      for (i = 0; i < from->len; i++) {
+        m = from->list[i];
+        lab->next[lab->last[root]] = m;
+        lab->last[root] = m;
+        lab->next[m] = -1;
+        lab->cells[root] += 1;
+        counts->size += 1;
+        count_cell(counts, lab->vmap[m].contents, m, 1);
+
+        FOR_ADJ_ON(m, new_loc, j) {
+          if (lab->vmap[new_loc].contents == ' ') {
+            if (label_stamp[new_loc] != label_time) {
+              label_stamp[new_loc] = label_time;
+              counts->size += 1;
+              counts->unexplored += 1;
+            }
+          } else if (lab->parent[new_loc] < 0 && label_good(lab, new_loc)) {
+            lab->parent[new_loc] = root;
+            to->list[to->len] = new_loc;
+            to->len += 1;
+          }
+        }
+      }
+      SWAP(from, to);
+    }
+  }
+  lab->valid = true;
+}
+
+/* Return the labeling for a map and terrain, building it if need be. */
+
+static labeling_t *label_map(view_map_t *vmap, char bad_terrain) {
+  labeling_t *lab = find_labeling(vmap, bad_terrain);
+
+  if (lab && !lab->valid) label_build(lab);
+  return lab;
+}
+
+/*
+Keep the labelings of a map current when a cell changes.  Pieces
+only ever move over explored cells, so anything but a reveal just
+changes the counts of the cell's continent.
+*/
+
+static void labels_changed(view_map_t *vmap, loc_t loc, int old_contents,
+                           int new_contents) {
+  int i;
+  labeling_t *lab;
+  scan_counts_t *counts;
+
+  if (!map[loc].on_board) return; /* never part of a continent */
+
+  for (i = 0; i < NUM_LABELINGS; i++) {
+    lab = &labelings[i];
+    if (!lab->valid || lab->vmap != vmap) continue;
+
+    if (old_contents == ' ')
+      label_reveal(lab, loc);
+    else if (new_contents == ' ') /* forgotten; start over */
+      lab->valid = false;
+    else if (lab->parent[loc] >= 0) {
+      counts = &lab->counts[label_find(lab, loc)];
+      count_cell(counts, old_contents, loc, -1);
+      count_cell(counts, new_contents, loc, 1);
+    }
+  }
+}
+
+/*
+Forget every labeling, and the census and explore predictions of each
+view map.  We do this when the view maps are written wholesale rather
+than through update().
+*/
+
+void vmap_forget_conts(void) {
+  int i;
+
+  for (i = 0; i < NUM_LABELINGS; i++) labelings[i].valid = false;
+  forget_census();
+  forget_basin_counts(NULL);
+  forget_predictions();
+  forget_overlays();
+  cont_changes[0] += 1;
+  cont_changes[1] += 1;
+}
+
+/*
+Return a label for the continent holding a cell:  two cells have the
+same label iff they are on the same continent.  We return -1 for a
+cell that is unexplored or not on a continent of this kind.
+*/
+
+int vmap_cont_label(view_map_t *vmap, loc_t loc, char bad_terrain) {
+  labeling_t *lab = label_map(vmap, bad_terrain);
+
+  if (lab == NULL || lab->parent[loc] < 0) return -1;
+  return label_find(lab, loc);
+}
+
+/*
+Return the counts for the continent holding a cell.  This gives
+the same answer as vmap_cont() followed by vmap_cont_scan(), but
+for a labeled map it is just a lookup.
+*/
+
+scan_counts_t vmap_cont_counts(view_map_t *vmap, loc_t loc,
+                               char bad_terrain) {
+  static int *cont_map;
+  labeling_t *lab = label_map(vmap, bad_terrain);
+
+  if (lab && lab->parent[loc] >= 0) return lab->counts[label_find(lab, loc)];
+
+  if (cont_map == NULL) cont_map = xalloc(MAP_SIZE, sizeof(int));
+  vmap_cont(cont_map, vmap, loc, bad_terrain);
+  return vmap_cont_scan(cont_map, vmap);
+}
+
+/*
+Return a count of the changes to a view map that might change what
+vmap_cont_all() finds:  cells coming into view, and changes to the
+cells of cities.  Pieces moving about are not counted.
+*/
+
+long vmap_cont_version(view_map_t *vmap) {
+  return cont_changes[vmap == user_map];
+}
+
+/*
+Map out every continent of a map in one sweep.  We set each cell of
+'cont_map' to the number of the continent the cell is on, counting
+from 1, or to 0 if the cell is not on a continent.  'counts[n]' is
+set to what vmap_cont_scan() would find on continent 'n'.  We return
+the number of continents.
+*/
+
+int vmap_cont_all(int *cont_map, scan_counts_t *counts, view_map_t *vmap,
+                  char bad_terrain) {
+  loc_t loc, m, new_loc;
+  int i, j, n;
+  perimeter_t *from, *to;
+
+  (void)memset((char *)cont_map, '\0', MAP_SIZE * sizeof(int));
+  n = 0;
+
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    if (cont_map[loc] || !cont_good(vmap, loc, bad_terrain)) continue;
+
+    n += 1;
+    (void)memset((char *)&counts[n], '\0', sizeof(scan_counts_t));
+    cont_map[loc] = n;
+    label_time += 1;
+
+    from = &p1;
+    to = &p2;
+    from->len = 1;
+    from->list[0] = loc;
+
+    while (from->len) {
+      to->len = 0;
+      for (i = 0; i < from->len; i++) {
+        m = from->list[i];
+        counts[n].size += 1;
+        count_cell(&counts[n], vmap[m].contents, m, 1);
+
+        FOR_ADJ_ON(m, new_loc, j) {
+          if (vmap[new_loc].contents == ' ') {
+            if (label_stamp[new_loc] != label_time) {
+              label_stamp[new_loc] = label_time;
+              counts[n].size += 1;
+              counts[n].unexplored += 1;
+            }
+          } else if (!cont_map[new_loc] &&
+                     cont_good(vmap, new_loc, bad_terrain)) {
+            cont_map[new_loc] = n;
+            to->list[to->len] = new_loc;
+            to->len += 1;
+          }
+        }
+      }
+      SWAP(from, to);
+    }
+  }
+  return n;
+}
+
+/*
+Water basins.  A ship looking for an objective in a body of water
+that holds none floods the whole body before giving up.  To save
+that, we label the cells a ship may cross (water, unexplored
+territory, and cities of the ship's owner, as terrain_type() has
+it) into basins, and the cells an army may cross (land and
+unexplored territory) into land masses, and note which land masses
+touch each basin.  A search can then see at once whether any of its
+objectives lie in or next to the piece's basin, or, for a search
+that may go ashore, next to a land mass touching the basin.
+
+The labels only depend on terrain, so we keep them until the
+terrain changes.  For the view maps we can tell when that happens.
+A caller searching a map of its own must name the map's terrain
+with vmap_set_terrain() each time it writes the map, or the map is
+searched in full.
+*/
 
-Someday this should be tweaked to use perimeter lists.
+#define NUM_BASIN_SETS 4 /* view maps, and a couple of scratch maps */
+#define NUM_SCRATCH 4    /* scratch maps whose terrain we know */
+
+typedef struct {
+  long terrain;         /* terrain the labels were made for */
+  int owner;            /* owner whose cities a ship may enter */
+  bool valid;           /* true iff labels have been made */
+  int nbasins;          /* number of basins */
+  int nlands;           /* number of land masses */
+  int *water;           /* basin of each cell, or 0 */
+  int *land;            /* land mass of each cell, or 0 */
+  int *first;           /* where each basin's land masses start */
+  int *shore;           /* land masses touching each basin, by basin */
+  int listed;           /* 1 if 'near' is made, -1 if too long, else 0 */
+  int *near_first;      /* where each cell's labels start in 'near' */
+  int *near;            /* labels of the counts; see near_labels() */
+} basin_set_t;
+
+static basin_set_t basin_sets[NUM_BASIN_SETS];
+static int next_basin_set; /* slot to reuse when we need a new set */
+
+static struct {
+  view_map_t *vmap;
+  long terrain;
+} scratch[NUM_SCRATCH];
+
+static uchar *cell_class;      /* T_LAND, T_WATER or both */
+static int (*shore_pairs)[2];  /* basin and land mass pairs */
+static int *shore_sorted;      /* their land masses, by basin */
+static long *land_mark;        /* land masses touching a basin */
+static long mark_time;
+
+/*
+Return a number naming the terrain of a map, or -1 if we don't
+know it.  View maps get negative numbers of their own, and scratch
+maps the numbers their callers gave them.
 */
 
-static void rmap_mark_up_cont(int *cont_map, loc_t loc, char bad_terrain) {
+long vmap_terrain(view_map_t *vmap) {
   int i;
+
+  if (vmap == comp_map) return -2 - 2 * cont_changes[0];
+  if (vmap == user_map) return -3 - 2 * cont_changes[1];
+
+  for (i = 0; i < NUM_SCRATCH; i++)
+    if (scratch[i].vmap == vmap) return scratch[i].terrain;
+  return -1;
+}
+
+/*
+Name the terrain of a scratch map.  Two maps given the same number
+must have the same terrain, though what is on it may differ.  A
+copy of a view map may be given the view map's number, or else the
+caller keeps its own count.  Passing -1 forgets the map's terrain.
+*/
+
+void vmap_set_terrain(view_map_t *vmap, long terrain) {
+  int i, slot;
+
+  slot = -1;
+  for (i = 0; i < NUM_SCRATCH; i++) {
+    if (scratch[i].vmap == vmap) break;
+    if (scratch[i].vmap == NULL && slot < 0) slot = i;
+  }
+  if (i < NUM_SCRATCH) slot = i;
+  if (slot < 0) return; /* table full; map is searched in full */
+
+  scratch[slot].vmap = vmap;
+  scratch[slot].terrain = terrain;
+}
+
+/*
+Label the cells of one class into sets, going down the map a row at
+a time as rmap_cont_all() does.  We return the number of sets.
+*/
+
+static int label_class(int *label, int type) {
+  int back[4] = {-1, -MAP_WIDTH - 1, -MAP_WIDTH, -MAP_WIDTH + 1};
+  loc_t loc, new_loc;
+  int i, n, m, ntemp, nsets;
+
+  ntemp = 0;
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    label[loc] = 0;
+    if (!(cell_class[loc] & type)) continue;
+
+    n = 0;
+    for (i = 0; i < 4; i++) {
+      new_loc = loc + back[i];
+      if (new_loc < 0 || label[new_loc] == 0) continue;
+
+      m = cont_find(label[new_loc]);
+      if (n == 0)
+        n = m;
+      else if (m < n) {
+        cont_parent[n] = m;
+        n = m;
+      } else if (m > n)
+        cont_parent[m] = n;
+    }
+    if (n == 0) {
+      n = ++ntemp;
+      cont_parent[n] = n;
+    }
+    label[loc] = n;
+  }
+  nsets = 0;
+  for (n = 1; n <= ntemp; n++)
+    if (cont_parent[n] == n) cont_parent[n] = -(++nsets);
+  for (loc = 0; loc < MAP_SIZE; loc++)
+    if (label[loc]) {
+      for (n = label[loc]; cont_parent[n] > 0; n = cont_parent[n])
+        ;
+      label[loc] = -cont_parent[n];
+    }
+  return nsets;
+}
+
+/* Label the basins and land masses of a map. */
+
+static void build_basins(basin_set_t *bs, view_map_t *vmap) {
+  loc_t loc, new_loc;
+  int i, j, b, npairs, nbasins;
+
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    cell_class[loc] = 0;
+    if (!map[loc].on_board) continue;
+
+    switch (vmap[loc].contents) {
+      case MAP_LAND:
+        cell_class[loc] = T_LAND;
+        break;
+      case MAP_SEA:
+        cell_class[loc] = T_WATER;
+        break;
+      case ' ':
+        cell_class[loc] = T_AIR;
+        break;
+      case '%': /* magic objective */
+        break;
+      default:
+        if (map[loc].contents == MAP_SEA)
+          cell_class[loc] = T_WATER;
+        else if (map[loc].contents == MAP_LAND)
+          cell_class[loc] = T_LAND;
+        else if (map[loc].cityp->owner == bs->owner)
+          cell_class[loc] = T_WATER;
+    }
+  }
+  nbasins = label_class(bs->water, T_WATER);
+  bs->nbasins = nbasins;
+  bs->nlands = label_class(bs->land, T_LAND);
+
+  /* list the land masses a piece may go ashore on from each basin */
+  npairs = 0;
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    b = bs->water[loc];
+    if (b == 0) continue;
+
+    if (bs->land[loc]) { /* unexplored cells are in both */
+      shore_pairs[npairs][0] = b;
+      shore_pairs[npairs][1] = bs->land[loc];
+      npairs += 1;
+    }
+    FOR_ADJ_ON(loc, new_loc, j) {
+      if (bs->land[new_loc] == 0) continue;
+      if (npairs > 0 && shore_pairs[npairs - 1][0] == b &&
+          shore_pairs[npairs - 1][1] == bs->land[new_loc])
+        continue; /* same as the last one */
+      shore_pairs[npairs][0] = b;
+      shore_pairs[npairs][1] = bs->land[new_loc];
+      npairs += 1;
+    }
+  }
+  /* sort the pairs by basin, then drop repeats */
+  for (b = 0; b <= nbasins + 1; b++) bs->first[b] = 0;
+  for (i = 0; i < npairs; i++) bs->first[shore_pairs[i][0] + 1] += 1;
+  for (b = 1; b <= nbasins + 1; b++) bs->first[b] += bs->first[b - 1];
+
+  for (i = 0; i < npairs; i++) {
+    b = shore_pairs[i][0];
+    shore_sorted[bs->first[b]] = shore_pairs[i][1];
+    bs->first[b] += 1;
+  }
+  j = 0;
+  i = 0;
+  for (b = 1; b <= nbasins; b++) {
+    mark_time += 1;
+    for (; i < bs->first[b]; i++) {
+      if (land_mark[shore_sorted[i]] == mark_time) continue;
+      land_mark[shore_sorted[i]] = mark_time;
+      if (j == MAP_SIZE) return; /* too many to list; leave invalid */
+      bs->shore[j++] = shore_sorted[i];
+    }
+    bs->first[b] = j; /* for now, where the basin ends */
+  }
+  for (b = nbasins; b > 0; b--) bs->first[b + 1] = bs->first[b];
+  bs->first[1] = 0;
+  bs->valid = true;
+}
+
+/*
+Return the basins of a map for a piece of some owner, labeling them
+if need be.  We return NULL if we don't know the map's terrain.
+*/
+
+static basin_set_t *find_basins(view_map_t *vmap, int owner) {
+  int i;
+  long terrain;
+  basin_set_t *bs;
+
+  terrain = vmap_terrain(vmap);
+  if (terrain == -1) return NULL;
+
+  for (i = 0; i < NUM_BASIN_SETS; i++) {
+    bs = &basin_sets[i];
+    if (bs->valid && bs->terrain == terrain && bs->owner == owner) return bs;
+  }
+  bs = &basin_sets[next_basin_set]; /* take over the oldest slot */
+  next_basin_set = (next_basin_set + 1) % NUM_BASIN_SETS;
+  bs->terrain = terrain;
+  bs->owner = owner;
+  bs->valid = false;
+  bs->listed = 0;
+  build_basins(bs, vmap);
+  return bs->valid ? bs : NULL;
+}
+
+/*
+Basin counts.  For each basin and land mass we count the cells in or
+next to it that show each character, so a search can tell from the
+counts alone whether any of its objectives is near the piece's basin.
+A scratch map shares the labels of the view map it is made from, but
+not what the cells show, so the counts are kept for a map and a basin
+set together.  We count a map in full the first time we are asked
+about it, and after that keep the counts up to date through
+vmap_changed(), vmap_set_contents() and vmap_overlay().
+
+The characters a map shows are counted in a few dozen slots, with any
+other character in slot 0.  We can't tell whether a map shows a
+character of slot 0, or anything about a map with too many labels to
+count.
+*/
+
+#define NUM_BASIN_COUNTS 6 /* view maps, and scratch maps */
+#define NUM_SLOTS 40       /* characters counted for each label */
+
+#define NEAR_POOL (MAP_SIZE * 3) /* room for the labels of every cell */
+
+typedef struct {
+  view_map_t *vmap; /* map counted, or NULL */
+  basin_set_t *bs;  /* labels counted by */
+  long terrain;     /* and their terrain and owner then */
+  int owner;
+  int *count; /* NUM_SLOTS for each basin, then for each land mass */
+} basin_count_t;
+
+static basin_count_t basin_counts[NUM_BASIN_COUNTS];
+static int next_basin_count; /* slot to reuse for a new count */
+static uchar char_slot[256];  /* where each character is counted */
+static long max_labels;       /* most labels a count has room for */
+
+/* Number the slots of the characters a map may show. */
+
+static void init_slots(void) {
+  static char slot_chars[] = " .+*OX$x0123456789";
+  int i, n;
+
+  n = 1;
+  for (i = 0; slot_chars[i]; i++) char_slot[(uchar)slot_chars[i]] = n++;
+  for (i = 0; i < NUM_OBJECTS; i++) {
+    char_slot[(uchar)piece_attr[i].sname] = n++;
+    char_slot[(uchar)(piece_attr[i].sname - 'A' + 'a')] = n++;
+  }
+  ASSERT(n <= NUM_SLOTS);
+}
+
+/*
+List the labels a cell on the board is in or next to, each once, as
+indices into the counts.  We return the number listed.
+*/
+
+static int near_labels(basin_set_t *bs, loc_t loc, int *labels) {
+  int i, j, k, n, label[2];
   loc_t new_loc;
 
-  if (!map[loc].on_board) return;               /* off board */
-  if (cont_map[loc]) return;                    /* already marked */
-  if (map[loc].contents == bad_terrain) return; /* off continent */
+  n = 0;
+  for (i = -1; i < 8; i++) {
+    new_loc = i < 0 ? loc : loc + dir_offset[i];
+    if (!map[new_loc].on_board) continue;
+
+    label[0] = bs->water[new_loc];
+    label[1] = bs->land[new_loc] ? bs->nbasins + bs->land[new_loc] : 0;
+    for (k = 0; k < 2; k++) {
+      if (label[k] == 0) continue;
+      for (j = 0; j < n && labels[j] != label[k]; j++)
+        ;
+      if (j == n) labels[n++] = label[k];
+    }
+  }
+  return n;
+}
+
+/*
+List the labels of every cell of a basin set once, since a cell is
+counted each time it changes.  We return false if there are too many.
+*/
+
+static bool list_near(basin_set_t *bs) {
+  loc_t loc;
+  long n;
+
+  if (bs->listed) return bs->listed > 0;
+  bs->listed = -1;
+  n = 0;
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    bs->near_first[loc] = n;
+    if (!map[loc].on_board) continue;
+    if (n + 18 > NEAR_POOL) return false;
+    n += near_labels(bs, loc, &bs->near[n]);
+  }
+  bs->near_first[MAP_SIZE] = n;
+  bs->listed = 1;
+  return true;
+}
+
+/* Count a cell showing 'contents', or uncount it if 'delta' is -1. */
+
+static void basin_count_cell(basin_count_t *bc, loc_t loc, int contents,
+                             int delta) {
+  basin_set_t *bs = bc->bs;
+  int *count = &bc->count[char_slot[(uchar)contents]];
+  long i;
+
+  for (i = bs->near_first[loc]; i < bs->near_first[loc + 1]; i++)
+    count[bs->near[i] * NUM_SLOTS] += delta;
+}
+
+/*
+Return the counts of a map by a basin set, counting the map if need
+be.  We return NULL if the set has too many labels.
+*/
+
+static basin_count_t *find_basin_count(view_map_t *vmap, basin_set_t *bs) {
+  basin_count_t *bc;
+  loc_t loc;
+  int i;
+
+  for (i = 0; i < NUM_BASIN_COUNTS; i++) {
+    bc = &basin_counts[i];
+    if (bc->vmap == vmap && bc->bs == bs && bc->terrain == bs->terrain &&
+        bc->owner == bs->owner)
+      return bc;
+  }
+  if (bs->nbasins + bs->nlands >= max_labels || !list_near(bs)) return NULL;
+
+  bc = &basin_counts[next_basin_count]; /* take over the oldest slot */
+  next_basin_count = (next_basin_count + 1) % NUM_BASIN_COUNTS;
+  bc->vmap = vmap;
+  bc->bs = bs;
+  bc->terrain = bs->terrain;
+  bc->owner = bs->owner;
+
+  (void)memset((char *)bc->count, '\0',
+               (bs->nbasins + bs->nlands + 1) * NUM_SLOTS * sizeof(int));
+  for (loc = 0; loc < MAP_SIZE; loc++)
+    if (map[loc].on_board) basin_count_cell(bc, loc, vmap[loc].contents, 1);
+  return bc;
+}
+
+/* Note that a cell of a map is about to change. */
+
+static void basin_counts_changed(view_map_t *vmap, loc_t loc, int old_contents,
+                                 int new_contents) {
+  int old_slot = char_slot[(uchar)old_contents];
+  int new_slot = char_slot[(uchar)new_contents];
+  basin_count_t *bc;
+  basin_set_t *bs;
+  int *count;
+  long i, k;
+
+  if (old_slot == new_slot || !map[loc].on_board) return;
+  for (i = 0; i < NUM_BASIN_COUNTS; i++) {
+    bc = &basin_counts[i];
+    if (bc->vmap != vmap) continue;
+    bs = bc->bs;
+    if (bc->terrain != bs->terrain || bc->owner != bs->owner ||
+        bs->listed <= 0) {
+      bc->vmap = NULL; /* labels were remade */
+      continue;
+    }
+    for (k = bs->near_first[loc]; k < bs->near_first[loc + 1]; k++) {
+      count = &bc->count[bs->near[k] * NUM_SLOTS];
+      count[old_slot] -= 1;
+      count[new_slot] += 1;
+    }
+  }
+}
+
+/*
+Forget the counts of a map, when it is written wholesale, or of every
+map if 'vmap' is NULL.
+*/
+
+static void forget_basin_counts(view_map_t *vmap) {
+  int i;
+
+  for (i = 0; i < NUM_BASIN_COUNTS; i++)
+    if (vmap == NULL || basin_counts[i].vmap == vmap)
+      basin_counts[i].vmap = NULL;
+}
+
+/* Return true iff a label might have cells near it showing 'chars'. */
+
+static bool label_near(basin_count_t *bc, int label, char *chars) {
+  int i;
+
+  for (i = 0; chars[i]; i++)
+    if (char_slot[(uchar)chars[i]] == 0 ||
+        bc->count[label * NUM_SLOTS + char_slot[(uchar)chars[i]]])
+      return true;
+  return false;
+}
+
+/*
+Return false if a ship at a location can reach none of its
+objectives, and true if it might.  If 'ashore' is set, the search
+may also go ashore and look for objectives on land.
+*/
+
+static bool basin_has_obj(view_map_t *vmap, loc_t loc, move_info_t *move_info,
+                          bool ashore) {
+  basin_set_t *bs;
+  basin_count_t *bc;
+  int b, k;
+
+  bs = find_basins(vmap, move_info->city_owner);
+  if (bs == NULL) return true;
+  b = bs->water[loc];
+  if (b == 0) return true; /* not afloat; can't tell */
+  bc = find_basin_count(vmap, bs);
+  if (bc == NULL) return true;
+
+  if (label_near(bc, b, move_info->objectives)) return true;
+  if (ashore)
+    for (k = bs->first[b]; k < bs->first[b + 1]; k++)
+      if (label_near(bc, bs->nbasins + bs->shore[k], move_info->objectives))
+        return true;
+  return false;
+}
+
+/*
+Return the number of cells in or next to the basin holding a location
+that show one of 'chars', for a piece of some owner, or -1 if we
+can't tell.
+*/
+
+long vmap_basin_count(view_map_t *vmap, int owner, loc_t loc, char *chars) {
+  basin_set_t *bs;
+  basin_count_t *bc;
+  long count;
+  int b, i, slot;
+
+  bs = find_basins(vmap, owner);
+  if (bs == NULL || (b = bs->water[loc]) == 0) return -1;
+  bc = find_basin_count(vmap, bs);
+  if (bc == NULL) return -1;
+
+  count = 0;
+  for (i = 0; chars[i]; i++) {
+    slot = char_slot[(uchar)chars[i]];
+    if (slot == 0) return -1;
+    count += bc->count[b * NUM_SLOTS + slot];
+  }
+  return count;
+}
+
+/*
+Continent graph.  The land masses of a basin set are the nodes of a
+graph whose edges are the crossings between them:  for each pair of
+land masses that face each other across a basin, the basin and the
+fewest water cells a transport must cross to carry an army from one
+to the other.  An army deciding whether to go to sea can ask the
+graph whether there is anywhere worth going before it searches the
+map cell by cell.
+
+We find the crossings by flooding the basins outward from all their
+shores at once, noting which land mass each water cell is reached
+from.  Where the floods from two land masses meet, the land masses
+face each other, and the crossing is the sum of the two distances.
+This gives the shortest crossing between each pair of land masses
+whose floods meet.  Any other pair is joined through the land masses
+between them.
+
+The graph is made from the labels of a basin set, so it is remade
+only when they are, when the terrain of the map changes.
+*/
+
+#define MAX_CROSS_PAIRS (MAP_SIZE * 4)
+
+typedef struct {
+  int land;  /* land mass across the water */
+  int basin; /* basin crossed */
+  int cost;  /* water cells crossed */
+} crossing_t;
+
+typedef struct {
+  int from, to; /* land masses, from < to */
+  int basin, cost;
+} cross_pair_t;
+
+static struct {
+  basin_set_t *bs; /* labels the graph was made from */
+  long terrain;    /* and their terrain and owner then */
+  int owner;
+  bool valid;
+  int *first;        /* where each land mass's crossings start */
+  crossing_t *cross; /* MAX_CROSS_PAIRS * 2 long */
+} cont_graph;
+
+static cross_pair_t *cross_pairs;
+static int *cross_from;  /* land mass a water cell is reached from */
+static int *cross_dist;  /* and the water cells crossed to reach it */
+static loc_t *cross_queue;
+static int *land_cost;   /* cost to reach each land mass */
+static int *land_open;   /* land masses reached but not done */
+
+/* Note a crossing.  We return false if there are too many to note. */
+
+static bool add_crossing(int *npairs, int a, int b, int basin, int cost) {
+  cross_pair_t *cp;
+
+  if (a == b) return true;
+  if (a > b) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+  if (*npairs > 0) {
+    cp = &cross_pairs[*npairs - 1];
+    if (cp->from == a && cp->to == b && cp->cost <= cost)
+      return true; /* same as the last one */
+  }
+  if (*npairs == MAX_CROSS_PAIRS) return false;
+
+  cp = &cross_pairs[(*npairs)++];
+  cp->from = a;
+  cp->to = b;
+  cp->basin = basin;
+  cp->cost = cost;
+  return true;
+}
+
+static int cmp_crossing(const void *a, const void *b) {
+  const cross_pair_t *x = a, *y = b;
+
+  if (x->from != y->from) return x->from - y->from;
+  if (x->to != y->to) return x->to - y->to;
+  return x->cost - y->cost;
+}
+
+/* List a crossing as one of a land mass's edges. */
+
+static void add_edge(int from, int to, cross_pair_t *cp) {
+  crossing_t *cr;
+
+  cr = &cont_graph.cross[cont_graph.first[from]++];
+  cr->land = to;
+  cr->basin = cp->basin;
+  cr->cost = cp->cost;
+}
+
+/* Make the graph of a basin set, unless we have it.  False if we can't. */
+
+static bool build_crossings(basin_set_t *bs) {
+  loc_t loc, new_loc;
+  int i, k, n, head, tail, npairs;
+  cross_pair_t *cp;
+
+  if (cont_graph.valid && cont_graph.bs == bs &&
+      cont_graph.terrain == bs->terrain && cont_graph.owner == bs->owner)
+    return true;
+  cont_graph.valid = false;
+
+  /* start the flood from each water cell on a shore */
+  npairs = 0;
+  tail = 0;
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    cross_from[loc] = 0;
+    if (bs->water[loc] == 0) continue;
+
+    n = bs->land[loc]; /* unexplored cells are in both */
+    FOR_ADJ_ON(loc, new_loc, i) {
+      k = bs->land[new_loc];
+      if (k == 0) continue;
+      if (n == 0)
+        n = k;
+      else if (!add_crossing(&npairs, n, k, bs->water[loc], 1))
+        return false;
+    }
+    if (n == 0) continue;
+    cross_from[loc] = n;
+    cross_dist[loc] = 1;
+    cross_queue[tail++] = loc;
+  }
+  for (head = 0; head < tail; head++) {
+    loc = cross_queue[head];
+    FOR_ADJ_ON(loc, new_loc, i) {
+      if (bs->water[new_loc] == 0) continue;
+
+      if (cross_from[new_loc] == 0) {
+        cross_from[new_loc] = cross_from[loc];
+        cross_dist[new_loc] = cross_dist[loc] + 1;
+        cross_queue[tail++] = new_loc;
+      } else if (!add_crossing(&npairs, cross_from[loc], cross_from[new_loc],
+                               bs->water[loc],
+                               cross_dist[loc] + cross_dist[new_loc]))
+        return false;
+    }
+  }
+  /* keep the cheapest crossing of each pair, listed from both ends */
+  qsort(cross_pairs, npairs, sizeof(cross_pair_t), cmp_crossing);
+
+  for (n = 0; n <= bs->nlands + 1; n++) cont_graph.first[n] = 0;
+  k = 0;
+  for (i = 0; i < npairs; i++) {
+    cp = &cross_pairs[i];
+    if (k > 0 && cross_pairs[k - 1].from == cp->from &&
+        cross_pairs[k - 1].to == cp->to)
+      continue;
+    cross_pairs[k++] = *cp;
+    cont_graph.first[cp->from + 1] += 1;
+    cont_graph.first[cp->to + 1] += 1;
+  }
+  for (n = 1; n <= bs->nlands + 1; n++)
+    cont_graph.first[n] += cont_graph.first[n - 1];
+
+  for (i = 0; i < k; i++) {
+    cp = &cross_pairs[i];
+    add_edge(cp->from, cp->to, cp);
+    add_edge(cp->to, cp->from, cp);
+  }
+  for (n = bs->nlands + 1; n > 0; n--)
+    cont_graph.first[n] = cont_graph.first[n - 1];
+  cont_graph.first[0] = 0;
+
+  cont_graph.bs = bs;
+  cont_graph.terrain = bs->terrain;
+  cont_graph.owner = bs->owner;
+  cont_graph.valid = true;
+  return true;
+}
+
+/*
+Crossing answers.  Armies ask about crossings a land mass at a time:
+every army on a land mass gets the same answer, and the computer asks
+once for each army it moves.  So for a view map we keep the answer of
+each land mass we are asked about, along with the land masses worth
+reaching, until the labels change or a cell starts or stops showing
+one of the targets.  vmap_changed() tells us when that happens.
+*/
+
+static struct {
+  view_map_t *vmap; /* map the answers are for, or NULL */
+  basin_set_t *bs;  /* and its labels, terrain and owner */
+  long terrain;
+  int owner;
+  char_set_t set; /* targets asked about */
+  long time;      /* stamp of the answers and marks below */
+  long *stamp;    /* land masses answered */
+  int *cost;      /* and their answers */
+  long *target;   /* land masses worth reaching */
+} answers;
+
+/* Forget the answers if a change to a view map could alter them. */
+
+static void answers_changed(view_map_t *vmap, int old_contents,
+                            int new_contents) {
+  if (answers.vmap == vmap &&
+      (IN_SET(answers.set, old_contents) || IN_SET(answers.set, new_contents)))
+    answers.vmap = NULL;
+}
+
+/*
+Return the fewest water cells an army at a location must cross to
+reach another land mass showing one of 'targets' on or next to it,
+going by way of as many land masses as need be.  We return INFINITY
+if there is no such land mass, and 0 if we can't tell, in which case
+the caller should search the map.  'owner' is the owner of the
+transports, whose cities are water to them.
+*/
+
+int vmap_crossing(view_map_t *vmap, int owner, loc_t loc, char *targets) {
+  basin_set_t *bs;
+  char_set_t set;
+  loc_t i, new_loc;
+  int j, k, n, m, cost, nopen, first;
+
+  bs = find_basins(vmap, owner);
+  if (bs == NULL || bs->land[loc] == 0 || !build_crossings(bs)) return 0;
+  first = bs->land[loc];
+
+  make_char_set(&set, targets);
+  if (answers.vmap != vmap || answers.bs != bs ||
+      answers.terrain != bs->terrain || answers.owner != bs->owner ||
+      memcmp(&answers.set, &set, sizeof(set)) != 0) {
+    /* mark the land masses worth reaching */
+    answers.time += 1;
+    for (i = 0; i < MAP_SIZE; i++)
+      if (map[i].on_board && IN_SET(set, vmap[i].contents)) {
+        answers.target[bs->land[i]] = answers.time;
+        FOR_ADJ_ON(i, new_loc, j)
+        answers.target[bs->land[new_loc]] = answers.time;
+      }
+    /* scratch maps don't tell us when they change */
+    answers.vmap = vmap == comp_map || vmap == user_map ? vmap : NULL;
+    answers.bs = bs;
+    answers.terrain = bs->terrain;
+    answers.owner = bs->owner;
+    answers.set = set;
+  } else if (answers.stamp[first] == answers.time)
+    return answers.cost[first];
+
+  /* and look for the nearest one */
+  answers.stamp[first] = answers.time;
+  answers.cost[first] = INFINITY;
+  for (n = 1; n <= bs->nlands; n++) land_cost[n] = INFINITY;
+  land_cost[first] = 0;
+  land_open[0] = first;
+  nopen = 1;
+
+  while (nopen > 0) {
+    k = 0;
+    for (j = 1; j < nopen; j++)
+      if (land_cost[land_open[j]] < land_cost[land_open[k]]) k = j;
+    n = land_open[k];
+    land_open[k] = land_open[--nopen];
+
+    if (land_cost[n] > 0 && answers.target[n] == answers.time) {
+      answers.cost[first] = land_cost[n];
+      break;
+    }
+
+    for (k = cont_graph.first[n]; k < cont_graph.first[n + 1]; k++) {
+      m = cont_graph.cross[k].land;
+      cost = land_cost[n] + cont_graph.cross[k].cost;
+      if (cost >= land_cost[m]) continue;
+      if (land_cost[m] == INFINITY) land_open[nopen++] = m;
+      land_cost[m] = cost;
+    }
+  }
+  return answers.cost[first];
+}
+
+/*
+Map census.  We keep a count of the cells showing each character
+on the view maps, and on the scratch maps copied from them, so a
+search can tell at once that none of its objectives is on the map.
+update() keeps the view maps' counts through vmap_changed().  A
+scratch map is only counted if it is made with vmap_copy() and
+written with vmap_set_contents().
+*/
+
+#define NUM_CENSUS 6 /* view maps, and scratch maps */
+
+typedef struct {
+  view_map_t *vmap;
+  bool valid;      /* true iff the counts are right */
+  long count[256]; /* cells showing each character */
+} census_t;
+
+static census_t censuses[NUM_CENSUS];
+static int next_census = 2; /* slot to reuse for a scratch map */
+
+/* Return the census of a map, or NULL if it has none. */
+
+static census_t *find_census(view_map_t *vmap) {
+  int i;
+  census_t *cp;
+
+  if (censuses[0].vmap == NULL) { /* first use */
+    censuses[0].vmap = comp_map;
+    censuses[1].vmap = user_map;
+  }
+  for (i = 0; i < NUM_CENSUS; i++) {
+    cp = &censuses[i];
+    if (cp->vmap != vmap) continue;
+
+    if (!cp->valid && i < 2) { /* view maps can always be counted */
+      loc_t loc;
+
+      (void)memset((char *)cp->count, '\0', sizeof(cp->count));
+      for (loc = 0; loc < MAP_SIZE; loc++)
+        cp->count[(uchar)vmap[loc].contents] += 1;
+      cp->valid = true;
+    }
+    return cp->valid ? cp : NULL;
+  }
+  return NULL;
+}
+
+/* Give a scratch map the census of the view map it is made from. */
+
+static void copy_census(view_map_t *xmap, view_map_t *vmap) {
+  int i;
+  census_t *from, *to;
+
+  from = find_census(vmap);
+  for (i = 2; i < NUM_CENSUS; i++)
+    if (censuses[i].vmap == xmap) break;
+  if (i == NUM_CENSUS) { /* take over the oldest slot */
+    i = next_census;
+    next_census = next_census + 1 < NUM_CENSUS ? next_census + 1 : 2;
+  }
+  to = &censuses[i];
+  to->vmap = xmap;
+  to->valid = from != NULL;
+  if (from) (void)memcpy(to->count, from->count, sizeof(to->count));
+}
+
+/*
+Copy a view map into a scratch map, along with its census and the
+name of its terrain.
+*/
+
+void vmap_copy(view_map_t *xmap, view_map_t *vmap) {
+  (void)memcpy(xmap, vmap, sizeof(view_map_t) * MAP_SIZE);
+  forget_basin_counts(xmap);
+  vmap_set_terrain(xmap, vmap_terrain(vmap));
+  copy_census(xmap, vmap);
+  overlay_note(xmap, -1); /* no longer an overlay */
+}
+
+/* Set a cell of a scratch map, keeping its census. */
+
+void vmap_set_contents(view_map_t *xmap, loc_t loc, int contents) {
+  census_t *cp = find_census(xmap);
+
+  overlay_note(xmap, loc);
+  basin_counts_changed(xmap, loc, xmap[loc].contents, contents);
+  if (cp) {
+    cp->count[(uchar)xmap[loc].contents] -= 1;
+    cp->count[(uchar)contents] += 1;
+  }
+  xmap[loc].contents = contents;
+}
+
+/*
+Return the number of cells of a map showing a character, or -1 if
+we don't know.
+*/
+
+long vmap_census(view_map_t *vmap, int contents) {
+  census_t *cp = find_census(vmap);
+
+  return cp ? cp->count[(uchar)contents] : -1;
+}
+
+/* Return false if none of a search's objectives is on a map. */
+
+static bool census_has_obj(view_map_t *vmap, move_info_t *move_info) {
+  census_t *cp = find_census(vmap);
+  int i;
+
+  if (cp == NULL) return true;
+  for (i = 0; move_info->objectives[i]; i++)
+    if (cp->count[(uchar)move_info->objectives[i]]) return true;
+  return false;
+}
+
+/* Forget the census of each view map. */
+
+static void forget_census(void) {
+  censuses[0].valid = false;
+  censuses[1].valid = false;
+}
+
+/* Note that a cell of a view map has changed. */
+
+static void census_changed(view_map_t *vmap, int old_contents,
+                           int new_contents) {
+  census_t *cp;
+
+  cp = &censuses[vmap == user_map];
+  if (cp->vmap != vmap || !cp->valid) return;
+  cp->count[(uchar)old_contents] -= 1;
+  cp->count[(uchar)new_contents] += 1;
+}
+
+/*
+Overlay maps.  Most scratch maps are a view map with a few cells
+marked, made again for each piece that moves.  Rather than copy the
+whole view map each time, vmap_overlay() keeps a list of the cells
+of the scratch map that may differ from the view map:  those written
+with vmap_set_contents(), and those that vmap_changed() reports have
+changed on the view map.  Making the map again copies just those.
+
+An overlay must only be written with vmap_set_contents(), and only
+the contents of its cells are kept, not the dates they were seen.
+*/
+
+#define NUM_OVERLAYS 4
+
+typedef struct {
+  view_map_t *xmap; /* scratch map, or NULL if slot unused */
+  view_map_t *vmap; /* view map it is made from */
+  bool valid;       /* false if it must be copied in full */
+  long len;         /* cells in 'list' */
+  loc_t *list;      /* cells that may differ from the view map */
+  bool *listed;     /* true iff a cell is in 'list' */
+} overlay_t;
+
+static overlay_t overlays[NUM_OVERLAYS];
+static int next_overlay; /* slot to reuse when we need a new overlay */
+
+/* Add a cell to the list of an overlay. */
+
+static void overlay_add(overlay_t *op, loc_t loc) {
+  if (op->listed[loc]) return;
+  op->listed[loc] = true;
+  op->list[op->len] = loc;
+  op->len += 1;
+}
+
+/*
+Note that a cell of a scratch map has been written, or with 'loc'
+of -1, that the whole map has.
+*/
 
-  cont_map[loc] = 1; /* on continent */
+static void overlay_note(view_map_t *xmap, loc_t loc) {
+  int i;
 
-  FOR_ADJ(loc, new_loc, i)
-  rmap_mark_up_cont(cont_map, new_loc, bad_terrain);
+  for (i = 0; i < NUM_OVERLAYS; i++) {
+    if (overlays[i].xmap != xmap) continue;
+    if (loc < 0)
+      overlays[i].valid = false;
+    else if (overlays[i].valid)
+      overlay_add(&overlays[i], loc);
+  }
 }
 
-/*
-Scan a continent recording items of interest on the continent.
-
-This could be done as we mark up the continent.
-*/
+/* Note that a cell of a view map has changed. */
 
-#define COUNT(c, item) \
-  case c:              \
-    item += 1;         \
-    break
+static void overlays_changed(view_map_t *vmap, loc_t loc) {
+  int i;
 
-scan_counts_t vmap_cont_scan(int *cont_map, view_map_t *vmap) {
-  scan_counts_t counts;
-  count_t i;
+  for (i = 0; i < NUM_OVERLAYS; i++)
+    if (overlays[i].vmap == vmap && overlays[i].valid)
+      overlay_add(&overlays[i], loc);
+}
 
-  (void)memset((char *)&counts, '\0', sizeof(scan_counts_t));
+/* Forget every overlay, when the view maps are loaded. */
 
-  for (i = 0; i < MAP_SIZE; i++) {
-    if (cont_map[i]) { /* cell on continent? */
-      counts.size += 1;
+static void forget_overlays(void) {
+  int i;
 
-      switch (vmap[i].contents) {
-        COUNT(' ', counts.unexplored);
-        COUNT('O', counts.user_cities);
-        COUNT('A', counts.user_objects[ARMY]);
-        COUNT('F', counts.user_objects[FIGHTER]);
-        COUNT('P', counts.user_objects[PATROL]);
-        COUNT('D', counts.user_objects[DESTROYER]);
-        COUNT('S', counts.user_objects[SUBMARINE]);
-        COUNT('T', counts.user_objects[TRANSPORT]);
-        COUNT('C', counts.user_objects[CARRIER]);
-        COUNT('B', counts.user_objects[BATTLESHIP]);
-        COUNT('X', counts.comp_cities);
-        COUNT('a', counts.comp_objects[ARMY]);
-        COUNT('f', counts.comp_objects[FIGHTER]);
-        COUNT('p', counts.comp_objects[PATROL]);
-        COUNT('d', counts.comp_objects[DESTROYER]);
-        COUNT('s', counts.comp_objects[SUBMARINE]);
-        COUNT('t', counts.comp_objects[TRANSPORT]);
-        COUNT('c', counts.comp_objects[CARRIER]);
-        COUNT('b', counts.comp_objects[BATTLESHIP]);
-        COUNT(MAP_CITY, counts.unowned_cities);
-        case MAP_LAND:
-          break;
-        case MAP_SEA:
-          break;
-        default: /* check for city underneath */
-          if (map[i].contents == MAP_CITY) {
-            switch (map[i].cityp->owner) {
-              COUNT(USER, counts.user_cities);
-              COUNT(COMP, counts.comp_cities);
-              COUNT(UNOWNED, counts.unowned_cities);
-            }
-          }
-      }
-    }
-  }
-  return counts;
+  for (i = 0; i < NUM_OVERLAYS; i++) overlays[i].valid = false;
 }
 
 /*
-Scan a real map as above.  Only the 'size' and 'unowned_cities'
-fields are valid.
+Make a scratch map show the same cells as a view map, as vmap_copy()
+does, copying only the cells that have changed since the scratch map
+was last made from this view map.
 */
 
-scan_counts_t rmap_cont_scan(int *cont_map) {
-  scan_counts_t counts;
-  count_t i;
-
-  (void)memset((char *)&counts, '\0', sizeof(scan_counts_t));
-
-  for (i = 0; i < MAP_SIZE; i++) {
-    if (cont_map[i]) { /* cell on continent? */
-      counts.size += 1;
-      if (map[i].contents == MAP_CITY) counts.unowned_cities += 1;
+void vmap_overlay(view_map_t *xmap, view_map_t *vmap) {
+  overlay_t *op;
+  loc_t loc;
+  long i;
+
+  for (i = 0; i < NUM_OVERLAYS; i++)
+    if (overlays[i].xmap == xmap) break;
+  if (i == NUM_OVERLAYS) { /* take over the oldest slot */
+    i = next_overlay;
+    next_overlay = (next_overlay + 1) % NUM_OVERLAYS;
+    overlays[i].xmap = NULL;
+  }
+  op = &overlays[i];
+
+  if (op->xmap != xmap || op->vmap != vmap || !op->valid) {
+    vmap_copy(xmap, vmap);
+    for (i = 0; i < op->len; i++) op->listed[op->list[i]] = false;
+  } else {
+    for (i = 0; i < op->len; i++) {
+      loc = op->list[i];
+      basin_counts_changed(xmap, loc, xmap[loc].contents, vmap[loc].contents);
+      xmap[loc].contents = vmap[loc].contents;
+      op->listed[loc] = false;
     }
+    vmap_set_terrain(xmap, vmap_terrain(vmap));
+    copy_census(xmap, vmap);
   }
-  return counts;
+  op->xmap = xmap;
+  op->vmap = vmap;
+  op->valid = true;
+  op->len = 0;
 }
 
 /*
-Return true if a location is on the edge of a continent.
+Watching a view map.  A caller may have the cells of a view map that
+change listed, each once, as vmap_changed() reports them.  Calling
+vmap_watch() again starts a new list, and a NULL map stops watching.
 */
 
-bool map_cont_edge(int *cont_map, loc_t loc) {
-  loc_t i, j;
-
-  if (!cont_map[loc]) return false; /* not on continent */
+static struct {
+  view_map_t *vmap;  /* map being watched, or NULL */
+  perimeter_t *list; /* cells that have changed */
+  bool *listed;      /* true iff a cell is in 'list' */
+} watch;
+
+void vmap_watch(view_map_t *vmap, perimeter_t *list) {
+  long i;
+
+  if (watch.vmap)
+    for (i = 0; i < watch.list->len; i++)
+      watch.listed[watch.list->list[i]] = false;
+  watch.vmap = vmap;
+  watch.list = list;
+  if (vmap) list->len = 0;
+}
 
-  FOR_ADJ(loc, j, i)
-  if (!cont_map[j]) return true; /* edge of continent */
+/* Note that a cell of a view map has changed. */
 
-  return false;
+static void watch_changed(view_map_t *vmap, loc_t loc) {
+  if (vmap != watch.vmap || watch.listed[loc]) return;
+  watch.listed[loc] = true;
+  watch.list->list[watch.list->len] = loc;
+  watch.list->len += 1;
 }
 
 /*
@@ -261,32 +1939,369 @@ the current perimeter is at least as large as the weighted distance
 to the best objective, we return the location of the best objective
 found.
 
-The 'cost' field in a path_map must be INFINITY if the cell lies
-outside of the current perimeter.  The cost for cells that lie
-on or within the current perimeter doesn't matter, except that
-the information must be consistent with the needs of 'vmap_mark_path'.
+A cell lies outside of the current perimeter iff its stamp is not
+the generation of the current search; such a cell has an implied
+cost of INFINITY.  The cost for cells that lie on or within the
+current perimeter doesn't matter, except that the information must
+be consistent with the needs of 'vmap_mark_path'.
+*/
+
+/*
+The searches differ only in what each cell of the perimeter may be
+expanded into, and what it costs to get there.  A search model
+describes this.  A cell's step is chosen by its terrain, if the model
+keeps land and water cells apart, and by whether its cost is odd or
+even, which lets a model charge two for a land move while it lets a
+piece move twice at sea.
+
+Costs are small, so the perimeters for the next few costs are kept in
+a ring of buckets.  Each bucket holds a list of water cells (or of all
+cells, if the model does not keep them apart), then a list of land
+cells, and we expand them in that order.  Every 'stride' costs, we stop
+if the best objective costs no more than the next bucket.
+*/
+
+typedef struct {
+  int expand;    /* type of terrain to expand */
+  int inc_wcost; /* cost to enter new water cells */
+  int inc_lcost; /* cost to enter new land cells */
+} search_step_t;
+
+typedef struct {
+  int start;                 /* terrain of the starting cell */
+  bool by_terrain;           /* true iff land and water are listed apart */
+  int stride;                /* costs between checks for completion */
+  char *trace;               /* title for traces of the path map */
+  search_step_t step[2][2];  /* indexed by list, then cost parity */
+} search_model_t;
+
+#define NUM_BUCKETS 4 /* must exceed the largest step cost */
+#define WATER_LIST 0
+#define LAND_LIST 1
+
+static _Thread_local perimeter_t buckets[NUM_BUCKETS][2];
+
+/* land costs 2 and water 1; land may be left for water */
+static search_model_t lw_model = {T_LAND, true, 2, "After lwobj loop:",
+                                  {{{T_WATER, 1, 1}, {T_WATER, 1, 1}},
+                                   {{T_AIR, 1, 2}, {T_AIR, 1, 2}}}};
+
+/* the reverse, except that water is only left for land every other cost */
+static search_model_t wl_model = {T_WATER, true, 2, "After wlobj loop:",
+                                  {{{T_AIR, 1, 2}, {T_WATER, 1, 1}},
+                                   {{T_LAND, 1, 2}, {T_LAND, 1, 2}}}};
+
+static loc_t search(path_map_t *pmap, view_map_t *vmap, loc_t loc,
+                    move_info_t *move_info, search_model_t *model,
+                    int beat_cost)
+/* beat_cost = cost an objective must beat to be of interest */
+{
+  int cur_cost;
+  int b, i;
+  long queued;
+  search_step_t *step;
+  perimeter_t *curp;
+
+  if (buckets[0][WATER_LIST].list == NULL) /* thread's first search */
+    for (b = 0; b < NUM_BUCKETS; b++) {
+      alloc_perimeter(&buckets[b][WATER_LIST]);
+      alloc_perimeter(&buckets[b][LAND_LIST]);
+    }
+  for (b = 0; b < NUM_BUCKETS; b++) {
+    buckets[b][WATER_LIST].len = 0;
+    buckets[b][LAND_LIST].len = 0;
+  }
+
+  i = (model->by_terrain && model->start == T_LAND) ? LAND_LIST : WATER_LIST;
+  start_perimeter(pmap, &buckets[0][i], loc, model->start, move_info);
+  best_cost = beat_cost; /* we can do this well */
+
+  for (cur_cost = 0;; cur_cost++) {
+    b = cur_cost % NUM_BUCKETS;
+
+    for (i = WATER_LIST; i <= LAND_LIST; i++) {
+      curp = &buckets[b][i];
+      if (curp->len == 0) continue;
+
+      step = &model->step[i][cur_cost % 2];
+      expand_perimeter(
+          pmap, vmap, move_info, curp, step->expand, cur_cost, step->inc_wcost,
+          step->inc_lcost,
+          &buckets[(cur_cost + step->inc_wcost) % NUM_BUCKETS][WATER_LIST],
+          &buckets[(cur_cost + step->inc_lcost) % NUM_BUCKETS]
+                  [model->by_terrain ? LAND_LIST : WATER_LIST]);
+      curp->len = 0;
+    }
+    if ((cur_cost + 1) % model->stride != 0) continue;
+
+    if (trace_pmap && !planning) print_pzoom(model->trace, pmap, vmap);
+
+    queued = 0;
+    for (b = 0; b < NUM_BUCKETS; b++)
+      queued += buckets[b][WATER_LIST].len + buckets[b][LAND_LIST].len;
+    if (queued == 0 || best_cost <= cur_cost + 1) return best_loc;
+  }
+}
+
+/*
+Give up on a search that can find nothing, leaving the path map as
+the search would have.
 */
 
+static loc_t no_obj(path_map_t *path_map, loc_t loc, int start,
+                    move_info_t *move_info) {
+  start_perimeter(path_map, &p1, loc, start, move_info);
+  path_stats.skipped += 1;
+  return loc;
+}
+
 /* Find an objective over a single type of terrain. */
 
-loc_t vmap_find_xobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_xobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                      move_info_t *move_info, int start, int expand) {
+  static search_model_t model = {T_LAND, false, 1, "After xobj loop:"};
+  dist_field_t *field;
+  int i;
+
+  if (!census_has_obj(vmap, move_info))
+    return no_obj(path_map, loc, start, move_info);
+
+  field = find_field(vmap, loc, move_info, expand);
+  if (field)
+    return field_find_obj(path_map, vmap, loc, move_info, start, expand,
+                          field);
+
+  model.start = start;
+  for (i = 0; i < 2; i++) {
+    model.step[0][i].expand = expand;
+    model.step[0][i].inc_wcost = 1;
+    model.step[0][i].inc_lcost = 1;
+  }
+  return search(path_map, vmap, loc, move_info, &model, INFINITY);
+}
+
+/*
+Return the type of terrain at a location for a field.  Unlike
+'terrain_type' we cannot know where a search comes from, so
+unexplored territory can be crossed by anything.
+*/
+
+static int field_terrain(int contents, int owner, loc_t loc) {
+  switch (contents) {
+    case MAP_LAND:
+      return T_LAND;
+    case MAP_SEA:
+      return T_WATER;
+    case ' ':
+      return T_AIR;
+  }
+  switch (map[loc].contents) {
+    case MAP_SEA:
+      return T_WATER;
+    case MAP_LAND:
+      return T_LAND;
+  }
+  if (map[loc].cityp->owner == owner) return T_WATER;
+  return T_UNKNOWN;
+}
+
+/*
+Return the field for a search, building it if need be.  We return
+NULL if the search cannot use a field.
+*/
+
+static dist_field_t *find_field(view_map_t *vmap, loc_t loc,
+                                move_info_t *move_info, int expand) {
+  int i;
+  dist_field_t *field;
+
+  if (vmap != comp_map && vmap != user_map) return NULL;
+  if (!move_info->compiled) compile_move_info(move_info);
+
+  /* a search never stops at its start, but a field would count it */
+  if (move_info->cost[(uchar)vmap[loc].contents] != INFINITY) return NULL;
+
+  for (i = 0; move_info->objectives[i]; i++)
+    if (move_info->weights[i] < 0) return NULL;
+
+  for (i = 0; i < NUM_FIELDS; i++) {
+    field = &fields[i];
+    if (field->vmap == vmap && field->move_info == move_info &&
+        field->expand == expand)
+      break;
+  }
+  if (i == NUM_FIELDS) { /* take over the oldest slot */
+    field = &fields[next_field];
+    next_field = (next_field + 1) % NUM_FIELDS;
+    field->vmap = vmap;
+    field->move_info = move_info;
+    field->expand = expand;
+    field->valid = false;
+    field->searches = 0;
+  }
+  /* a field only pays once a second piece searches the same map */
+  if (!field->valid && field->searches++ == 0) return NULL;
+  if (!field->valid) build_field(field);
+  return field;
+}
+
+static dist_field_t *sort_field; /* field whose sources we are sorting */
+
+static int cmp_source(const void *a, const void *b) {
+  return sort_field->cost[*(const long *)a] -
+         sort_field->cost[*(const long *)b];
+}
+
+/*
+Build a field.  Each cell of the right terrain next to an objective
+is a source, with the cost of the best objective next to it.  Since
+sources may have different costs, we sort them, and add each to the
+perimeter when the search reaches its cost.  A source already reached
+more cheaply is passed over.
+*/
+
+static void build_field(dist_field_t *field) {
+  view_map_t *vmap = field->vmap;
+  move_info_t *move_info = field->move_info;
+  perimeter_t *from = &p1;
+  perimeter_t *to = &p2;
+  perimeter_t *sources = &p3;
+  static char *cross; /* true iff searches may cross cell */
+  loc_t loc, new_loc;
+  long i, next;
+  int j, w, type, cur_cost;
+
+  if (cross == NULL) cross = xalloc(MAP_SIZE, sizeof(char));
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    field->cost[loc] = INFINITY;
+    type = field_terrain(vmap[loc].contents, move_info->city_owner, loc);
+    cross[loc] = map[loc].on_board && (type & field->expand);
+  }
+
+  sources->len = 0;
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    w = move_info->cost[(uchar)vmap[loc].contents];
+    if (w == INFINITY || !map[loc].on_board) continue;
+    /* can a search stop at this objective? */
+    type = field_terrain(vmap[loc].contents, move_info->city_owner, loc);
+    if (type != T_UNKNOWN && !(type & field->expand)) continue;
+
+    FOR_ADJ(loc, new_loc, j)
+    if (cross[new_loc]) {
+      if (field->cost[new_loc] == INFINITY) {
+        sources->list[sources->len] = new_loc;
+        sources->len += 1;
+      }
+      if (w < field->cost[new_loc]) field->cost[new_loc] = w;
+    }
+  }
+  sort_field = field;
+  qsort(sources->list, sources->len, sizeof(long), cmp_source);
+
+  from->len = 0;
+  next = 0;
+  cur_cost = 0;
+  for (;;) {
+    if (from->len == 0) { /* skip ahead to the next source */
+      while (next < sources->len && field->cost[sources->list[next]] < cur_cost)
+        next++; /* already reached more cheaply */
+      if (next == sources->len) break;
+      cur_cost = field->cost[sources->list[next]];
+    }
+    for (; next < sources->len; next++) {
+      loc = sources->list[next];
+      if (field->cost[loc] > cur_cost) break;
+      if (field->cost[loc] == cur_cost) {
+        from->list[from->len] = loc;
+        from->len += 1;
+      }
+    }
+    to->len = 0;
+    for (i = 0; i < from->len; i++)
+      FOR_ADJ(from->list[i], new_loc, j)
+    if (cross[new_loc] && field->cost[new_loc] > cur_cost + 1) {
+      field->cost[new_loc] = cur_cost + 1;
+      to->list[to->len] = new_loc;
+      to->len += 1;
+    }
+    cur_cost += 1;
+    SWAP(from, to);
+  }
+  field->valid = true;
+}
+
+/*
+Find an objective using a field.  We first work out the cost of the
+best objective from the cells around the piece, then search only the
+cells on a path of that cost.
+*/
+
+static loc_t field_find_obj(path_map_t *path_map, view_map_t *vmap,
+                            loc_t loc, move_info_t *move_info, int start,
+                            int expand, dist_field_t *field) {
   perimeter_t *from;
   perimeter_t *to;
   int cur_cost;
+  int goal; /* cost of best objective */
+  int i, j, w, type;
+  loc_t new_loc;
+  long gen;
 
   from = &p1;
   to = &p2;
 
-  start_perimeter(path_map, from, loc, start);
+  start_perimeter(path_map, from, loc, start, move_info);
+  gen = path_map->gen;
+
+  goal = INFINITY;
+  FOR_ADJ_ON(loc, new_loc, j) {
+    type = terrain_type(path_map, vmap, move_info, loc, new_loc);
+    if ((type & expand) && field->cost[new_loc] + 1 < goal)
+      goal = field->cost[new_loc] + 1;
+    if ((type & expand) || type == T_UNKNOWN) {
+      w = move_info->cost[(uchar)vmap[new_loc].contents];
+      if (w < goal) goal = w;
+    }
+  }
+  if (goal >= INFINITY) return loc; /* nothing we can reach */
+
   cur_cost = 0; /* cost to reach current perimeter */
 
   for (;;) {
     to->len = 0; /* nothing in perim yet */
-    expand_perimeter(path_map, vmap, move_info, from, expand, cur_cost, 1, 1,
-                     to, to);
 
-    if (trace_pmap) print_pzoom("After xobj loop:", path_map, vmap);
+    for (i = 0; i < from->len; i++)
+      FOR_ADJ(from->list[i], new_loc, j) {
+        if (path_map->stamp[new_loc] >= gen)
+          continue; /* already in perimeter? */
+
+        w = move_info->cost[(uchar)vmap[new_loc].contents];
+        if (w != INFINITY) w += cur_cost;
+        if (w != goal && cur_cost + 1 + field->cost[new_loc] != goal)
+          continue; /* not on a best path */
+
+        type = terrain_type(path_map, vmap, move_info, from->list[i], new_loc);
+        if (type & expand)
+          add_cell(path_map, new_loc, to, type, cur_cost, 1);
+        else if (type == T_UNKNOWN && w == goal) { /* unreachable objective */
+          path_map->stamp[new_loc] = gen;
+          path_map->terrain[new_loc] = T_UNKNOWN;
+          path_map->cost[new_loc] = cur_cost;
+          path_map->inc_cost[new_loc] = PMAP_FAR;
+        } else
+          continue;
+
+        if (w < best_cost) {
+          best_cost = w;
+          best_loc = new_loc;
+          if (type == T_UNKNOWN) {
+            path_map->cost[new_loc] = cur_cost + 2;
+            path_map->inc_cost[new_loc] = 2;
+          }
+        }
+      }
+
+    if (trace_pmap) print_pzoom("After field loop:", path_map, vmap);
 
     cur_cost += 1;
     if (to->len == 0 || best_cost <= cur_cost) return best_loc;
@@ -295,23 +2310,86 @@ loc_t vmap_find_xobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
   }
 }
 
+/*
+Called when a cell of a view map has changed.  We drop any field
+on the map for which the cell was or has become an objective, or
+for which it has changed between land and water, and bring the
+map's continent labels and census up to date.
+*/
+
+void vmap_changed(view_map_t *vmap, loc_t loc, int old_contents) {
+  int i;
+  int new_contents = vmap[loc].contents;
+  bool same_terrain;
+  dist_field_t *field;
+
+  /* pieces and cities are shown over terrain that never changes */
+  same_terrain = !SHOWS_TERRAIN(old_contents) && !SHOWS_TERRAIN(new_contents);
+
+  for (i = 0; i < NUM_FIELDS; i++) {
+    field = &fields[i];
+    if (field->vmap != vmap) continue;
+
+    if (field->move_info->cost[(uchar)old_contents] != INFINITY ||
+        field->move_info->cost[(uchar)new_contents] != INFINITY ||
+        (!same_terrain &&
+         field_terrain(old_contents, field->move_info->city_owner, loc) !=
+             field_terrain(new_contents, field->move_info->city_owner,
+                           loc))) {
+      field->valid = false;
+      field->searches = 0;
+    }
+  }
+  if (!same_terrain || map[loc].cityp)
+    sectors_changed(vmap, loc, old_contents, new_contents);
+  if (old_contents == ' ' || new_contents == ' ' || map[loc].cityp)
+    cont_changes[vmap == user_map] += 1;
+  labels_changed(vmap, loc, old_contents, new_contents);
+  census_changed(vmap, old_contents, new_contents);
+  basin_counts_changed(vmap, loc, old_contents, new_contents);
+  answers_changed(vmap, old_contents, new_contents);
+  predictions_changed(vmap, loc, old_contents, new_contents);
+  overlays_changed(vmap, loc);
+  watch_changed(vmap, loc);
+}
+
+/*
+Drop every field and sector graph, and the basins of the view maps.
+We do this when a map is loaded, and when a city changes hands,
+since cities a piece may enter depend on who owns them.
+*/
+
+void vmap_forget_fields(void) {
+  int i;
+
+  for (i = 0; i < NUM_FIELDS; i++) {
+    fields[i].valid = false;
+    fields[i].searches = 0;
+  }
+  for (i = 0; i < NUM_GRAPHS; i++) graphs[i].built = false;
+  cont_changes[0] += 1; /* cities a ship may enter have changed */
+  cont_changes[1] += 1;
+}
+
 /* Find an objective for a piece that crosses land and water. */
 
-loc_t vmap_find_aobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_aobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                      move_info_t *move_info) {
   return vmap_find_xobj(path_map, vmap, loc, move_info, T_LAND, T_AIR);
 }
 
 /* Find an objective for a piece that crosses only water. */
 
-loc_t vmap_find_wobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_wobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                      move_info_t *move_info) {
+  if (!basin_has_obj(vmap, loc, move_info, false))
+    return no_obj(path_map, loc, T_WATER, move_info);
   return vmap_find_xobj(path_map, vmap, loc, move_info, T_WATER, T_WATER);
 }
 
 /* Find an objective for a piece that crosses only land. */
 
-loc_t vmap_find_lobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_lobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                      move_info_t *move_info) {
   return vmap_find_xobj(path_map, vmap, loc, move_info, T_LAND, T_LAND);
 }
@@ -319,58 +2397,19 @@ loc_t vmap_find_lobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
 /*
 Find an objective moving from land to water.
 This is mildly complicated.  It costs 2 to move on land
-and one to move on water.  To handle this, we expand our current
-perimeter by one cell, where land can be expanded to either
-land or water, and water is only expanded to water.  Then
-we expand any water one more cell.
+and one to move on water.  Land can be expanded to either
+land or water, and water is only expanded to water; this
+is 'lw_model'.
 
 We have different objectives depending on whether the objective
 is being approached from the land or the water.
 */
 
-loc_t vmap_find_lwobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_lwobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                       move_info_t *move_info, int beat_cost) {
-  perimeter_t *cur_land;
-  perimeter_t *cur_water;
-  perimeter_t *new_land;
-  perimeter_t *new_water;
-  int cur_cost;
-
-  cur_land = &p1;
-  cur_water = &p2;
-  new_water = &p3;
-  new_land = &p4;
-
-  start_perimeter(path_map, cur_land, loc, T_LAND);
-  cur_water->len = 0;
-  best_cost = beat_cost; /* we can do this well */
-  cur_cost = 0;          /* cost to reach current perimeter */
-
-  for (;;) {
-    /* expand current perimeter one cell */
-    new_water->len = 0;
-    new_land->len = 0;
-    expand_perimeter(path_map, vmap, move_info, cur_water, T_WATER, cur_cost, 1,
-                     1, new_water, NULL);
-
-    expand_perimeter(path_map, vmap, move_info, cur_land, T_AIR, cur_cost, 1, 2,
-                     new_water, new_land);
-
-    /* expand new water one cell */
-    cur_water->len = 0;
-    expand_perimeter(path_map, vmap, move_info, new_water, T_WATER,
-                     cur_cost + 1, 1, 1, cur_water, NULL);
-
-    if (trace_pmap) print_pzoom("After lwobj loop:", path_map, vmap);
-
-    cur_cost += 2;
-    if ((cur_water->len == 0 && new_land->len == 0) ||
-        (best_cost <= cur_cost)) {
-      return best_loc;
-    }
-
-    SWAP(cur_land, new_land);
-  }
+  if (!census_has_obj(vmap, move_info))
+    return no_obj(path_map, loc, T_LAND, move_info);
+  return search(path_map, vmap, loc, move_info, &lw_model, beat_cost);
 }
 
 #ifdef __UNUSED__
@@ -387,8 +2426,8 @@ static int best_adj(path_map_t *pmap, loc_t loc, int type) {
   best = INFINITY;
 
   FOR_ADJ(loc, new_loc, i)
-  if (pmap[new_loc].terrain == type && pmap[new_loc].cost < best)
-    best = pmap[new_loc].cost;
+  if (pmap->terrain[new_loc] == type && pmap->cost[new_loc] < best)
+    best = pmap->cost[new_loc];
 
   return best;
 }
@@ -403,80 +2442,80 @@ We cheat ever so slightly, but this cheating accurately reflects
 the mechanics o moving.  The first time we expand water we can
 expand to land or water (army moving off tt or tt moving on water),
 but the second time, we only expand water (tt taking its second move).
+This is 'wl_model'.
 */
 
-loc_t vmap_find_wlobj(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_wlobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                       move_info_t *move_info) {
-  perimeter_t *cur_land;
-  perimeter_t *cur_water;
-  perimeter_t *new_land;
-  perimeter_t *new_water;
-  int cur_cost;
+  if (!census_has_obj(vmap, move_info) ||
+      !basin_has_obj(vmap, loc, move_info, true))
+    return no_obj(path_map, loc, T_WATER, move_info);
+  return search(path_map, vmap, loc, move_info, &wl_model, INFINITY);
+}
 
-  cur_land = &p1;
-  cur_water = &p2;
-  new_water = &p3;
-  new_land = &p4;
+/*
+Planning searches.  The computer may plan the moves of several armies
+at once, each on a thread of its own; see plan_armies() in compmove.c.
+These do the searches of vmap_find_lobj() and vmap_find_lwobj() in
+full, without the fields, census and basins the other searches keep
+up to date, so that threads share nothing but the view map, which no
+one writes while they run.  Each thread has its own perimeters and
+best objective, and its work is not counted in 'path_stats'.
+
+The objective found is one the full search would find, and
+vmap_plan_lwobj() also returns its cost through 'cost'.  vmap_prepare()
+must have been called for the move_info before any thread uses it.
+*/
 
-  start_perimeter(path_map, cur_water, loc, T_WATER);
-  cur_land->len = 0;
-  cur_cost = 0; /* cost to reach current perimeter */
+void vmap_prepare(move_info_t *move_info) {
+  if (!move_info->compiled) compile_move_info(move_info);
+}
 
-  for (;;) {
-    /* expand current perimeter one cell */
-    new_water->len = 0;
-    new_land->len = 0;
-    expand_perimeter(path_map, vmap, move_info, cur_water, T_AIR, cur_cost, 1,
-                     2, new_water, new_land);
-
-    expand_perimeter(path_map, vmap, move_info, cur_land, T_LAND, cur_cost, 1,
-                     2, NULL, new_land);
-
-    /* expand new water one cell to water */
-    cur_water->len = 0;
-    expand_perimeter(path_map, vmap, move_info, new_water, T_WATER,
-                     cur_cost + 1, 1, 1, cur_water, NULL);
-
-    if (trace_pmap) print_pzoom("After wlobj loop:", path_map, vmap);
-
-    cur_cost += 2;
-    if ((cur_water->len == 0 && new_land->len == 0) ||
-        (best_cost <= cur_cost)) {
-      return best_loc;
-    }
-    SWAP(cur_land, new_land);
-  }
+loc_t vmap_plan_lobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
+                     move_info_t *move_info) {
+  search_model_t model = {T_LAND, false, 1, "After xobj loop:",
+                          {{{T_LAND, 1, 1}, {T_LAND, 1, 1}}}};
+  loc_t found;
+
+  planning = true;
+  found = search(path_map, vmap, loc, move_info, &model, INFINITY);
+  planning = false;
+  return found;
+}
+
+loc_t vmap_plan_lwobj(path_map_t *path_map, view_map_t *vmap, loc_t loc,
+                      move_info_t *move_info, int beat_cost, int *cost) {
+  loc_t found;
+
+  planning = true;
+  found = search(path_map, vmap, loc, move_info, &lw_model, beat_cost);
+  *cost = best_cost;
+  planning = false;
+  return found;
 }
 
 /*
 Initialize the perimeter searching.
 
 This routine was taking a significant amount of the program time (10%)
-doing the initialization of the path map.  We now use an external
-constant and 'memcpy'.
+doing the initialization of the path map.  We used to copy a constant
+map over the path map; now we simply start a new generation, which
+leaves every cell outside the perimeter at no cost at all.
 */
 
-static path_map_t pmap_init[MAP_SIZE];
-static bool init_done = false;
-
 static void start_perimeter(path_map_t *pmap, perimeter_t *perim, loc_t loc,
-                            int terrain) {
-  /* zap the path map */
-  if (!init_done) {
-    int i;
+                            int terrain, move_info_t *move_info) {
+  if (!move_info->compiled) compile_move_info(move_info);
 
-    init_done = true;
-    for (i = 0; i < MAP_SIZE; i++) {
-      pmap_init[i].cost = INFINITY; /* everything lies outside perim */
-      pmap_init[i].terrain = T_UNKNOWN;
-    }
-  }
-  (void)memcpy((char *)pmap, (char *)pmap_init, sizeof(pmap_init));
+  /* zap the path map */
+  if (pmap->gen == 0 || pmap->gen >= PMAP_EDGE - 1) edge_path_map(pmap);
+  pmap->gen += 1;
 
   /* put first location in perimeter */
-  pmap[loc].cost = 0;
-  pmap[loc].inc_cost = 0;
-  pmap[loc].terrain = terrain;
+  pmap->stamp[loc] = pmap->gen;
+  pmap->cost[loc] = 0;
+  pmap->inc_cost[loc] = 0;
+  pmap->terrain[loc] = terrain;
 
   perim->len = 1;
   perim->list[0] = loc;
@@ -485,6 +2524,32 @@ static void start_perimeter(path_map_t *pmap, perimeter_t *perim, loc_t loc,
   best_loc = loc;       /* if nothing found, result is current loc */
 }
 
+/*
+Set up a path map whose generations are new or used up.  Every cell
+is put back before the first generation, and the cells on the edge
+of the board are stamped.
+*/
+
+static void edge_path_map(path_map_t *pmap) {
+  loc_t loc;
+  int row, col;
+
+  (void)memset(pmap->stamp, '\0', MAP_SIZE * sizeof(*pmap->stamp));
+  pmap->gen = 0;
+
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    row = loc_row(loc);
+    col = loc_col(loc);
+
+    if (row == 0 || row == MAP_HEIGHT - 1 || col == 0 || col == MAP_WIDTH - 1) {
+      pmap->stamp[loc] = PMAP_EDGE;
+      pmap->cost[loc] = 0;
+      pmap->inc_cost[loc] = PMAP_NONE;
+      pmap->terrain[loc] = T_UNKNOWN;
+    }
+  }
+}
+
 /*
 Expand the perimeter.
 
@@ -498,8 +2563,91 @@ type, we turn place the adjacent cell in either the new water perimeter
 or the new land perimeter.
 
 We set the cost to reach the current perimeter.
+
+The searches expand their perimeters in only a few ways, so the work
+is done by kernels built from one source, each with the type of terrain
+to expand and the costs of entering water and land fixed, letting the
+compiler drop the tests that cannot apply.  A kernel with nothing fixed
+handles any other case.  In debugging mode we count the cells each
+kernel expands and the time it takes.
 */
 
+#define EXPAND_KERNEL(name, TYPE, WCOST, LCOST)                              \
+  static void name(path_map_t *pmap, view_map_t *vmap,                       \
+                   move_info_t *move_info, perimeter_t *curp, int type,      \
+                   int cur_cost, int inc_wcost, int inc_lcost,               \
+                   perimeter_t *waterp, perimeter_t *landp) {                \
+    long i;                                                                  \
+    int j, w;                                                                \
+    int new_type, from_terrain;                                              \
+    uchar contents;                                                          \
+    loc_t loc, new_loc;                                                      \
+    int gen = pmap->gen;                                                     \
+                                                                             \
+    for (i = 0; i < curp->len; i++) { /* for each perimeter cell... */       \
+      loc = curp->list[i];                                                   \
+      from_terrain = pmap->terrain[loc];                                     \
+                                                                             \
+      FOR_ADJ(loc, new_loc, j) { /* for each adjacent cell... */             \
+        if (pmap->stamp[new_loc] >= gen) continue; /* inside perimeter? */   \
+                                                                             \
+        contents = vmap[new_loc].contents;                                   \
+        if (contents == MAP_LAND)                                            \
+          new_type = T_LAND;                                                 \
+        else if (contents == MAP_SEA)                                        \
+          new_type = T_WATER;                                                \
+        else if (contents == ' ')                                            \
+          new_type = from_terrain;                                           \
+        else                                                                 \
+          new_type = terrain_type(pmap, vmap, move_info, loc, new_loc);      \
+                                                                             \
+        if (new_type == T_LAND && ((TYPE)&T_LAND))                           \
+          add_cell(pmap, new_loc, landp, T_LAND, cur_cost, (LCOST));         \
+        else if (new_type == T_WATER && ((TYPE)&T_WATER))                    \
+          add_cell(pmap, new_loc, waterp, T_WATER, cur_cost, (WCOST));       \
+        else if (new_type == T_UNKNOWN) { /* unreachable cell? */            \
+          pmap->stamp[new_loc] = gen;                                        \
+          pmap->terrain[new_loc] = T_UNKNOWN;                                \
+          pmap->cost[new_loc] = cur_cost;                                    \
+          pmap->inc_cost[new_loc] = PMAP_FAR;                                \
+        } else                                                               \
+          continue; /* cannot enter this cell */                             \
+                                                                             \
+        w = move_info->cost[contents];                                       \
+        if (w == INFINITY) continue; /* not an objective */                  \
+        if (w >= 0)                                                          \
+          w += cur_cost;                                                     \
+        else                                                                 \
+          w = objective_cost(vmap, move_info, new_loc, cur_cost);            \
+                                                                             \
+        if (w < best_cost) {                                                 \
+          best_cost = w;                                                     \
+          best_loc = new_loc;                                                \
+          if (new_type == T_UNKNOWN) {                                       \
+            pmap->cost[new_loc] = cur_cost + 2;                              \
+            pmap->inc_cost[new_loc] = 2;                                     \
+          }                                                                  \
+        }                                                                    \
+      }                                                                      \
+    }                                                                        \
+  }
+
+EXPAND_KERNEL(expand_land, T_LAND, 1, 1)
+EXPAND_KERNEL(expand_water, T_WATER, 1, 1)
+EXPAND_KERNEL(expand_air, T_AIR, 1, 1)
+EXPAND_KERNEL(expand_land2, T_LAND, 2, 2)
+EXPAND_KERNEL(expand_mixed, T_AIR, 1, 2)
+EXPAND_KERNEL(expand_any, type, inc_wcost, inc_lcost)
+
+typedef void (*expand_kernel_t)(path_map_t *, view_map_t *, move_info_t *,
+                                perimeter_t *, int, int, int, int,
+                                perimeter_t *, perimeter_t *);
+
+/* indexed like 'expand_kernel_names' */
+static expand_kernel_t expand_kernels[NUM_EXPAND_KERNELS] = {
+    expand_land, expand_water, expand_air,
+    expand_land2, expand_mixed, expand_any};
+
 static void expand_perimeter(path_map_t *pmap, view_map_t *vmap,
                              move_info_t *move_info, perimeter_t *curp,
                              int type, int cur_cost, int inc_wcost,
@@ -515,52 +2663,60 @@ static void expand_perimeter(path_map_t *pmap, view_map_t *vmap,
 /* waterp = pointer to new water perimeter */
 /* landp = pointer to new land perimeter */
 {
-  register long i;
-  register int j;
-  loc_t new_loc;
-  int obj_cost;
-  register int new_type;
+  int k;
+  clock_t start = 0;
+
+  if (type == T_LAND && inc_lcost == 1)
+    k = 0;
+  else if (type == T_WATER && inc_wcost == 1)
+    k = 1;
+  else if (type == T_AIR && inc_wcost == 1 && inc_lcost == 1)
+    k = 2;
+  else if (type == T_LAND && inc_lcost == 2)
+    k = 3;
+  else if (type == T_AIR && inc_wcost == 1 && inc_lcost == 2)
+    k = 4;
+  else
+    k = 5;
 
-  for (i = 0; i < curp->len; i++)           /* for each perimeter cell... */
-    FOR_ADJ_ON(curp->list[i], new_loc, j) { /* for each adjacent cell... */
-      register path_map_t *pm = pmap + new_loc;
-
-      if (pm->cost == INFINITY) {
-        new_type = terrain_type(pmap, vmap, move_info, curp->list[i], new_loc);
-
-        if (new_type == T_LAND && (type & T_LAND))
-          add_cell(pmap, new_loc, landp, new_type, cur_cost, inc_lcost);
-        else if (new_type == T_WATER && (type & T_WATER))
-          add_cell(pmap, new_loc, waterp, new_type, cur_cost, inc_wcost);
-        else if (new_type == T_UNKNOWN) { /* unreachable cell? */
-          pm->terrain = new_type;
-          pm->cost = cur_cost + INFINITY / 2;
-          pm->inc_cost = INFINITY / 2;
-        }
-        if (pmap[new_loc].cost != INFINITY) { /* did we expand? */
-          obj_cost = objective_cost(vmap, move_info, new_loc, cur_cost);
-          if (obj_cost < best_cost) {
-            best_cost = obj_cost;
-            best_loc = new_loc;
-            if (new_type == T_UNKNOWN) {
-              pm->cost = cur_cost + 2;
-              pm->inc_cost = 2;
-            }
-          }
-        }
-      }
-    }
+  if (debug && !planning) start = clock();
+
+  expand_kernels[k](pmap, vmap, move_info, curp, type, cur_cost, inc_wcost,
+                    inc_lcost, waterp, landp);
+
+  if (debug && !planning) {
+    path_stats.expand_cells[k] += curp->len;
+    path_stats.expand_ticks[k] += clock() - start;
+  }
+}
+
+/*
+Build the table of objective costs for a move_info.  Each objective
+character is given its weight, and every other character is given
+INFINITY, so that finding the cost of a cell is a single lookup
+instead of a search through the list of objectives.  If a character
+appears in the list more than once, the first occurrence wins.
+*/
+
+static void compile_move_info(move_info_t *move_info) {
+  int i;
+
+  for (i = 0; i < 256; i++) move_info->cost[i] = INFINITY;
+
+  for (i = strlen(move_info->objectives) - 1; i >= 0; i--)
+    move_info->cost[(uchar)move_info->objectives[i]] = move_info->weights[i];
+
+  move_info->compiled = true;
 }
 
 /* Add a cell to a perimeter list. */
 
 static void add_cell(path_map_t *pmap, loc_t new_loc, perimeter_t *perim,
                      int terrain, int cur_cost, int inc_cost) {
-  register path_map_t *pm = &pmap[new_loc];
-
-  pm->terrain = terrain;
-  pm->inc_cost = inc_cost;
-  pm->cost = cur_cost + inc_cost;
+  pmap->stamp[new_loc] = pmap->gen;
+  pmap->terrain[new_loc] = terrain;
+  pmap->inc_cost[new_loc] = inc_cost;
+  pmap->cost[new_loc] = cur_cost + inc_cost;
 
   perim->list[perim->len] = new_loc;
   perim->len += 1;
@@ -570,14 +2726,11 @@ static void add_cell(path_map_t *pmap, loc_t new_loc, perimeter_t *perim,
 
 static int objective_cost(view_map_t *vmap, move_info_t *move_info, loc_t loc,
                           int base_cost) {
-  char *p;
   int w;
   city_info_t *cityp;
 
-  p = strchr(move_info->objectives, vmap[loc].contents);
-  if (!p) return INFINITY;
-
-  w = move_info->weights[p - move_info->objectives];
+  w = move_info->cost[(uchar)vmap[loc].contents];
+  if (w == INFINITY) return INFINITY;
   if (w >= 0) return w + base_cost;
 
   switch (w) {
@@ -610,7 +2763,7 @@ static int terrain_type(path_map_t *pmap, view_map_t *vmap,
   if (vmap[to_loc].contents == MAP_LAND) return T_LAND;
   if (vmap[to_loc].contents == MAP_SEA) return T_WATER;
   if (vmap[to_loc].contents == '%') return T_UNKNOWN; /* magic objective */
-  if (vmap[to_loc].contents == ' ') return pmap[from_loc].terrain;
+  if (vmap[to_loc].contents == ' ') return pmap->terrain[from_loc];
 
   switch (map[to_loc].contents) {
     case MAP_SEA:
@@ -637,10 +2790,9 @@ for land and water.  We iterate this algorithm until either
 the next iteration would remove all unexplored territory, or
 there is nothing more about which we can make an assumption.
 
-First, we use a pathmap to save the number of adjacent land
-and water cells for each unexplored cell.  Cells which have
-adjacent explored territory are placed in a perimeter list.
-We also count the number of cells that are not unexplored.
+First, we count the number of adjacent land and water cells for
+each unexplored cell.  Cells which have adjacent explored territory
+are placed in a perimeter list.
 
 We now take this perimeter list and make high-probability
 predictions.
@@ -654,91 +2806,149 @@ We stop if at any point all remaining unexplored cells are
 in a perimeter list, or if no predictions were made during
 one of the final passes.
 
+Only a few cells come into view each turn, so we don't make the
+predictions afresh.  A prediction only spreads through unexplored
+cells, so each body of unexplored cells (cells next to each other,
+as FOR_ADJ has it) is predicted on its own, and the perimeter lists
+keep the cells of a body in the same order whether or not other
+bodies are in the lists too.  So we predict each body as if it
+were the only one, noting the pass in which each cell is predicted
+and how many unexplored cells are off the perimeter at the start
+of each pass.  From those counts we find the pass at which the
+whole map would stop, and take the predictions made before it.  A
+body is predicted again only when one of its cells comes into view.
+
 Unlike other algorithms, here we deal with "off board" locations.
 So be careful.
 */
 
-void vmap_prune_explore_locs(view_map_t *vmap) {
-  path_map_t pmap[MAP_SIZE];
-  perimeter_t *from, *to;
-  int explored;
-  loc_t loc, new_loc;
-  count_t i;
-  long copied;
+#define PRED_MEDIUM (MAP_SIZE + 2) /* pass number of medium predictions */
+#define PRED_POOL (4 * MAP_SIZE)   /* room for counts of cells off perimeter */
+
+typedef struct {
+  loc_t head;     /* first cell of body */
+  int high;       /* high probability passes making predictions */
+  int low;        /* low probability passes making predictions */
+  int first;      /* where its counts of cells off perimeter start */
+  int live_index; /* place in 'pred_live' */
+} pred_body_t;
+
+static struct {
+  view_map_t *vmap; /* view map the predictions are for */
+  bool valid;       /* true iff predictions have been made */
+  int pool_len;     /* entries of 'pool' in use, live or not */
+  int nlive;        /* bodies in 'pred_live' */
+  int nfree;        /* bodies in 'pred_free' */
+  int ndirty;       /* cells in 'pred_dirty' */
+} pred;
+
+static pred_body_t *pred_bodies;
+static int *pred_live;       /* bodies being predicted */
+static int *pred_free;       /* body numbers not in use */
+static int *pred_pool;       /* counts of cells off perimeter */
+static int *body_of;         /* body of an unexplored cell, or 0 */
+static loc_t *next_cell;     /* next cell of same body, or -1 */
+static int *pred_pass;       /* pass predicting a cell, or 0 */
+static char *pred_contents;  /* what it is predicted to be */
+static uchar *land_count;    /* land and water next to a cell */
+static uchar *water_count;
+static loc_t *pred_dirty;    /* cells that came into or out of view */
+static bool *is_dirty;
+static loc_t *pred_queue;    /* cells of a body being labeled */
+static loc_t *pred_redo;     /* cells to label into bodies again */
+static int npredicted;                 /* cells of a body predicted so far */
+
+/* Predict what a cell is, and count it next to its unexplored neighbors. */
+
+static void predict_cell(loc_t loc, int type, int pass, perimeter_t *to) {
+  int i;
+  loc_t new_loc;
 
-  (void)memset(pmap, '\0', sizeof(pmap));
-  from = &p1;
-  to = &p2;
-  from->len = 0;
-  explored = 0;
+  pred_contents[loc] = type == T_LAND ? MAP_LAND : MAP_SEA;
+  pred_pass[loc] = pass;
+  npredicted += 1;
 
-  /* build initial path map and perimeter list */
-  for (loc = 0; loc < MAP_SIZE; loc++) {
-    if (vmap[loc].contents != ' ')
-      explored += 1;
-    else { /* add unexplored cell to perim */
-      FOR_ADJ(loc, new_loc, i) {
-        if (new_loc < 0 || new_loc >= MAP_SIZE)
-          ; /* ignore off map */
-        else if (vmap[new_loc].contents == ' ')
-          ; /* ignore adjacent unexplored */
-        else if (map[new_loc].contents != MAP_SEA)
-          pmap[loc].cost += 1; /* count land */
-        else
-          pmap[loc].inc_cost += 1; /* count water */
-      }
-      if (pmap[loc].cost || pmap[loc].inc_cost) {
-        from->list[from->len] = loc;
-        from->len += 1;
-      }
+  FOR_ADJ(loc, new_loc, i)
+  if (new_loc >= 0 && new_loc < MAP_SIZE && body_of[new_loc] &&
+      pred_pass[new_loc] == 0) {
+    if (!land_count[new_loc] && !water_count[new_loc]) {
+      to->list[to->len] = new_loc;
+      to->len += 1;
     }
+    if (type == T_LAND)
+      land_count[new_loc] += 1;
+    else
+      water_count[new_loc] += 1;
   }
+}
+
+static int cmp_loc(const void *a, const void *b) {
+  return *(const long *)a - *(const long *)b;
+}
 
-  if (print_vmap == 'I') print_xzoom(vmap);
+/*
+Make the predictions for one body, whose cells have been counted
+and whose perimeter is in 'from'.  We return false if there is no
+room to save the counts of cells off the perimeter.
+*/
+
+static bool predict_body(pred_body_t *pb, int ncells, perimeter_t *from,
+                         perimeter_t *to) {
+  int *left; /* cells off the perimeter at the start of each pass */
+  int pass;
+  long i, copied;
+  loc_t loc;
+
+  /* each pass but the last two predicts a cell */
+  if (pred.pool_len + ncells + 2 > PRED_POOL) return false;
+  pb->first = pred.pool_len;
+  left = &pred_pool[pb->first];
+  npredicted = 0;
 
-  for (;;) { /* do high probability predictions */
-    if (from->len + explored == MAP_SIZE) return;
+  /* the whole map's perimeter list starts in order */
+  qsort(from->list, from->len, sizeof(long), cmp_loc);
+
+  for (pass = 0;; pass++) { /* do high probability predictions */
+    left[pass] = ncells - npredicted - from->len;
     to->len = 0;
     copied = 0;
 
     for (i = 0; i < from->len; i++) {
       loc = from->list[i];
-      if (pmap[loc].cost >= 5)
-        expand_prune(vmap, pmap, loc, T_LAND, to, &explored);
-      else if (pmap[loc].inc_cost >= 5)
-        expand_prune(vmap, pmap, loc, T_WATER, to, &explored);
+      if (land_count[loc] >= 5)
+        predict_cell(loc, T_LAND, pass + 1, to);
+      else if (water_count[loc] >= 5)
+        predict_cell(loc, T_WATER, pass + 1, to);
       else if ((loc < MAP_WIDTH || loc >= MAP_SIZE - MAP_WIDTH) &&
-               pmap[loc].cost >= 3)
-        expand_prune(vmap, pmap, loc, T_LAND, to, &explored);
+               land_count[loc] >= 3)
+        predict_cell(loc, T_LAND, pass + 1, to);
       else if ((loc < MAP_WIDTH || loc >= MAP_SIZE - MAP_WIDTH) &&
-               pmap[loc].inc_cost >= 3)
-        expand_prune(vmap, pmap, loc, T_WATER, to, &explored);
-      else if ((loc == 0 || loc == MAP_SIZE - 1) && pmap[loc].cost >= 2)
-        expand_prune(vmap, pmap, loc, T_LAND, to, &explored);
-      else if ((loc == 0 || loc == MAP_SIZE - 1) && pmap[loc].inc_cost >= 2)
-        expand_prune(vmap, pmap, loc, T_WATER, to, &explored);
+               water_count[loc] >= 3)
+        predict_cell(loc, T_WATER, pass + 1, to);
+      else if ((loc == 0 || loc == MAP_SIZE - 1) && land_count[loc] >= 2)
+        predict_cell(loc, T_LAND, pass + 1, to);
+      else if ((loc == 0 || loc == MAP_SIZE - 1) && water_count[loc] >= 2)
+        predict_cell(loc, T_WATER, pass + 1, to);
       else { /* copy perimeter cell */
         to->list[to->len] = loc;
         to->len += 1;
         copied += 1;
       }
     }
-    if (copied == from->len) break; /* nothing expanded */
+    if (copied == from->len) break; /* nothing predicted */
     SWAP(from, to);
   }
-
-  if (print_vmap == 'I') print_xzoom(vmap);
+  pb->high = pass;
+  left += pass + 1;
 
   /* one pass for medium probability predictions */
-  if (from->len + explored == MAP_SIZE) return;
   to->len = 0;
-
   for (i = 0; i < from->len; i++) {
     loc = from->list[i];
-    if (pmap[loc].cost > pmap[loc].inc_cost)
-      expand_prune(vmap, pmap, loc, T_LAND, to, &explored);
-    else if (pmap[loc].cost < pmap[loc].inc_cost)
-      expand_prune(vmap, pmap, loc, T_WATER, to, &explored);
+    if (land_count[loc] > water_count[loc])
+      predict_cell(loc, T_LAND, PRED_MEDIUM, to);
+    else if (land_count[loc] < water_count[loc])
+      predict_cell(loc, T_WATER, PRED_MEDIUM, to);
     else { /* copy perimeter cell */
       to->list[to->len] = loc;
       to->len += 1;
@@ -746,131 +2956,771 @@ void vmap_prune_explore_locs(view_map_t *vmap) {
   }
   SWAP(from, to);
 
-  if (print_vmap == 'I') print_xzoom(vmap);
-
-  /* multiple low probability passes */
-  for (;;) {
-    /* return if very little left to explore */
-    if (from->len + explored >= MAP_SIZE - MAP_HEIGHT) {
-      if (print_vmap == 'I') print_xzoom(vmap);
-      return;
-    }
+  for (pass = 0;; pass++) { /* multiple low probability passes */
+    left[pass] = ncells - npredicted - from->len;
     to->len = 0;
     copied = 0;
 
     for (i = 0; i < from->len; i++) {
       loc = from->list[i];
-      if (pmap[loc].cost >= 4 && pmap[loc].inc_cost < 4)
-        expand_prune(vmap, pmap, loc, T_LAND, to, &explored);
-      else if (pmap[loc].inc_cost >= 4 && pmap[loc].cost < 4)
-        expand_prune(vmap, pmap, loc, T_WATER, to, &explored);
+      if (land_count[loc] >= 4 && water_count[loc] < 4)
+        predict_cell(loc, T_LAND, PRED_MEDIUM + pass + 1, to);
+      else if (water_count[loc] >= 4 && land_count[loc] < 4)
+        predict_cell(loc, T_WATER, PRED_MEDIUM + pass + 1, to);
       else if ((loc < MAP_WIDTH || loc >= MAP_SIZE - MAP_WIDTH) &&
-               pmap[loc].cost > pmap[loc].inc_cost)
-        expand_prune(vmap, pmap, loc, T_LAND, to, &explored);
+               land_count[loc] > water_count[loc])
+        predict_cell(loc, T_LAND, PRED_MEDIUM + pass + 1, to);
       else if ((loc < MAP_WIDTH || loc >= MAP_SIZE - MAP_WIDTH) &&
-               pmap[loc].inc_cost > pmap[loc].cost)
-        expand_prune(vmap, pmap, loc, T_WATER, to, &explored);
+               water_count[loc] > land_count[loc])
+        predict_cell(loc, T_WATER, PRED_MEDIUM + pass + 1, to);
       else { /* copy perimeter cell */
         to->list[to->len] = loc;
         to->len += 1;
         copied += 1;
       }
     }
-    if (copied == from->len) break; /* nothing expanded */
+    if (copied == from->len) break; /* nothing predicted */
     SWAP(from, to);
   }
-  if (print_vmap == 'I') print_xzoom(vmap);
+  pb->low = pass;
+  pred.pool_len = pb->first + pb->high + pb->low + 2;
+  return true;
 }
 
 /*
-Expand an unexplored cell.  We increment the land or water count
-of each neighbor.  Any neighbor that acquires a non-zero count
-is added to the 'to' perimiter list.  The count of explored
-territory is incremented.
+Label the body of unexplored cells holding a cell, count the land
+and water next to each of them, and make the body's predictions.
+We return false if there is no room to save them.
+*/
+
+static bool label_body(view_map_t *vmap, loc_t seed) {
+  int b, i;
+  loc_t loc, new_loc;
+  long head, tail;
+  pred_body_t *pb;
+
+  b = pred_free[--pred.nfree];
+  pb = &pred_bodies[b];
+  pb->head = -1;
+  pb->live_index = pred.nlive;
+  pred_live[pred.nlive++] = b;
+
+  p1.len = 0;
+  body_of[seed] = b;
+  pred_queue[0] = seed;
+  for (head = 0, tail = 1; head < tail; head++) {
+    loc = pred_queue[head];
+    next_cell[loc] = pb->head;
+    pb->head = loc;
+    pred_pass[loc] = 0;
+    land_count[loc] = 0;
+    water_count[loc] = 0;
+
+    FOR_ADJ(loc, new_loc, i) {
+      if (new_loc < 0 || new_loc >= MAP_SIZE)
+        ; /* ignore off map */
+      else if (vmap[new_loc].contents == ' ') {
+        if (body_of[new_loc] == 0) { /* unexplored cell of this body */
+          body_of[new_loc] = b;
+          pred_queue[tail++] = new_loc;
+        }
+      } else if (map[new_loc].contents != MAP_SEA)
+        land_count[loc] += 1; /* count land */
+      else
+        water_count[loc] += 1; /* count water */
+    }
+    if (land_count[loc] || water_count[loc]) {
+      p1.list[p1.len] = loc;
+      p1.len += 1;
+    }
+  }
+  return predict_body(pb, tail, &p1, &p2);
+}
+
+/* Forget the predictions of a body, noting its cells to label again. */
+
+static void drop_body(int b, long *nredo) {
+  pred_body_t *pb = &pred_bodies[b];
+  loc_t loc;
+  int last;
+
+  for (loc = pb->head; loc >= 0; loc = next_cell[loc]) {
+    body_of[loc] = 0;
+    pred_redo[(*nredo)++] = loc;
+  }
+  last = pred_live[--pred.nlive];
+  pred_live[pb->live_index] = last;
+  pred_bodies[last].live_index = pb->live_index;
+  pred_free[pred.nfree++] = b;
+}
+
+/* Predict every body of a view map afresh. */
+
+static void predict_all(view_map_t *vmap) {
+  loc_t loc;
+
+  pred.vmap = vmap;
+  pred.valid = true;
+  pred.pool_len = 0;
+  pred.nlive = 0;
+  pred.ndirty = 0;
+  for (pred.nfree = 0; pred.nfree < MAP_SIZE; pred.nfree++)
+    pred_free[pred.nfree] = MAP_SIZE - pred.nfree;
+
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    body_of[loc] = 0;
+    is_dirty[loc] = false;
+  }
+  for (loc = 0; loc < MAP_SIZE; loc++)
+    if (vmap[loc].contents == ' ' && body_of[loc] == 0)
+      if (!label_body(vmap, loc)) ABORT; /* there is room for every body */
+}
 
-Careful:  'loc' may be "off board".
+/* Predict again the bodies holding or next to cells that came into view. */
+
+static void predict_changes(view_map_t *vmap) {
+  int i, k;
+  long nredo;
+  loc_t loc, new_loc;
+
+  nredo = 0;
+  for (k = 0; k < pred.ndirty; k++) {
+    loc = pred_dirty[k];
+    is_dirty[loc] = false;
+    if (body_of[loc]) drop_body(body_of[loc], &nredo);
+    FOR_ADJ(loc, new_loc, i)
+    if (new_loc >= 0 && new_loc < MAP_SIZE && body_of[new_loc])
+      drop_body(body_of[new_loc], &nredo);
+    pred_redo[nredo++] = loc; /* in case it went out of view */
+  }
+  pred.ndirty = 0;
+
+  while (nredo > 0) {
+    loc = pred_redo[--nredo];
+    if (vmap[loc].contents != ' ' || body_of[loc]) continue;
+    if (!label_body(vmap, loc)) {
+      predict_all(vmap); /* out of room; start over */
+      return;
+    }
+  }
+}
+
+/* Forget the predictions, when the view maps are loaded. */
+
+static void forget_predictions(void) { pred.valid = false; }
+
+/*
+Note that a cell of a view map has come into view, or gone out of
+it.  Called by 'vmap_changed'.
 */
 
-static void expand_prune(view_map_t *vmap, path_map_t *pmap, loc_t loc,
-                         int type, perimeter_t *to, int *explored) {
-  int i;
-  loc_t new_loc;
+static void predictions_changed(view_map_t *vmap, loc_t loc, int old_contents,
+                                int new_contents) {
+  if (vmap != pred.vmap || !pred.valid) return;
+  if ((old_contents == ' ') == (new_contents == ' ')) return;
+  if (is_dirty[loc]) return;
+
+  is_dirty[loc] = true;
+  pred_dirty[pred.ndirty++] = loc;
+}
+
+/*
+Prune the unexplored territory of 'xmap', a copy of the view map
+'vmap', bringing the predictions for 'vmap' up to date first.
+*/
 
-  *explored += 1;
+void vmap_prune_explore_locs(view_map_t *xmap, view_map_t *vmap) {
+  int i, j, b, most, left, limit;
+  loc_t loc;
+  pred_body_t *pb;
 
-  if (type == T_LAND)
-    vmap[loc].contents = MAP_LAND;
+  if (vmap != pred.vmap || !pred.valid)
+    predict_all(vmap);
   else
-    vmap[loc].contents = MAP_SEA;
+    predict_changes(vmap);
+
+  vmap_set_terrain(xmap, -1); /* we are about to change it */
+  if (print_vmap == 'I') print_xzoom(xmap);
+
+  /* stop before a high probability pass with every cell on a perimeter */
+  most = 0;
+  for (i = 0; i < pred.nlive; i++)
+    if (pred_bodies[pred_live[i]].high > most)
+      most = pred_bodies[pred_live[i]].high;
+
+  limit = INFINITY;
+  for (j = 0; j <= most && limit == INFINITY; j++) {
+    left = 0;
+    for (i = 0; i < pred.nlive; i++) {
+      pb = &pred_bodies[pred_live[i]];
+      left += pred_pool[pb->first + (j < pb->high ? j : pb->high)];
+    }
+    if (left == 0) limit = j + 1;
+  }
 
-  FOR_ADJ(loc, new_loc, i)
-  if (new_loc >= 0 && new_loc < MAP_SIZE && vmap[new_loc].contents == ' ') {
-    if (!pmap[new_loc].cost && !pmap[new_loc].inc_cost) {
-      to->list[to->len] = new_loc;
-      to->len += 1;
+  /* or before a low probability pass with very little left to explore */
+  most = 0;
+  for (i = 0; i < pred.nlive; i++)
+    if (pred_bodies[pred_live[i]].low > most)
+      most = pred_bodies[pred_live[i]].low;
+
+  for (j = 0; j <= most && limit == INFINITY; j++) {
+    left = 0;
+    for (i = 0; i < pred.nlive; i++) {
+      pb = &pred_bodies[pred_live[i]];
+      left += pred_pool[pb->first + pb->high + 1 + (j < pb->low ? j : pb->low)];
     }
-    if (type == T_LAND)
-      pmap[new_loc].cost += 1;
-    else
-      pmap[new_loc].inc_cost += 1;
+    if (left <= MAP_HEIGHT) limit = PRED_MEDIUM + j + 1;
+  }
+
+  /* take the predictions made before then */
+  for (i = 0; i < pred.nlive; i++) {
+    b = pred_live[i];
+    for (loc = pred_bodies[b].head; loc >= 0; loc = next_cell[loc])
+      if (pred_pass[loc] && pred_pass[loc] < limit)
+        vmap_set_contents(xmap, loc, pred_contents[loc]);
   }
+  if (print_vmap == 'I') print_xzoom(xmap);
 }
 
 /*
-Find the shortest path from the current location to the
-destination which passes over valid terrain.  We return
-the destination if a path exists.  Otherwise we return the
-origin.
+Return the sector graph for a search for a destination, setting up
+a slot for it if need be.  We return NULL if the search cannot use a
+graph.
+*/
+
+static sector_graph_t *find_graph(view_map_t *vmap, int owner, int terrain) {
+  sector_graph_t *graph;
+
+  if (vmap != comp_map && vmap != user_map) return NULL;
+  if (terrain != T_LAND && terrain != T_WATER) return NULL;
+
+  graph = &graphs[(vmap == user_map) * 2 + (terrain == T_WATER)];
+  if (graph->vmap != vmap || graph->owner != owner) {
+    graph->vmap = vmap;
+    graph->terrain = terrain;
+    graph->owner = owner;
+    graph->built = false;
+  }
+  return graph;
+}
+
+/* Return true iff a piece using a sector graph may cross a cell. */
+
+static bool sector_cross(sector_graph_t *graph, loc_t loc) {
+  return map[loc].on_board &&
+         (field_terrain(graph->vmap[loc].contents, graph->owner, loc) &
+          graph->terrain);
+}
+
+/* Set a box to the cells within 'around' sectors of a sector. */
+
+static void sector_box(box_t *box, int sector, int around) {
+  box->row0 = (sector / PSECTOR_COLS - around) * PSECTOR_SIZE;
+  box->col0 = (sector % PSECTOR_COLS - around) * PSECTOR_SIZE;
+  box->row1 = box->row0 + (2 * around + 1) * PSECTOR_SIZE - 1;
+  box->col1 = box->col0 + (2 * around + 1) * PSECTOR_SIZE - 1;
+
+  if (box->row0 < 0) box->row0 = 0;
+  if (box->col0 < 0) box->col0 = 0;
+  if (box->row1 > MAP_HEIGHT - 1) box->row1 = MAP_HEIGHT - 1;
+  if (box->col1 > MAP_WIDTH - 1) box->col1 = MAP_WIDTH - 1;
+}
+
+/*
+Called by 'vmap_changed' when the terrain or city shown at a cell has
+changed.  If the cell may have changed between crossable and not, we
+mark its sector and the sectors around it, whose entrances may depend
+on it.
+*/
+
+static void sectors_changed(view_map_t *vmap, loc_t loc, int old_contents,
+                            int new_contents) {
+  int i, j;
+  int old_type, new_type;
+  loc_t new_loc;
+  sector_graph_t *graph;
+
+  for (i = 0; i < NUM_GRAPHS; i++) {
+    graph = &graphs[i];
+    if (graph->vmap != vmap || !graph->built) continue;
+
+    /* we cannot tell who owned a city, so we assume the worst */
+    if (!map[loc].cityp) {
+      old_type = field_terrain(old_contents, graph->owner, loc);
+      new_type = field_terrain(new_contents, graph->owner, loc);
+      if (!(old_type & graph->terrain) == !(new_type & graph->terrain))
+        continue;
+    }
+
+    graph->sector[loc_psector(loc)].dirty = true;
+    FOR_ADJ_ON(loc, new_loc, j)
+    graph->sector[loc_psector(new_loc)].dirty = true;
+  }
+}
+
+/* Make a cell an entrance to its sector, unless it is already. */
+
+static void add_entrance(sector_graph_t *graph, psector_t *sp, loc_t loc) {
+  if (graph->entrance_of[loc] >= 0) return;
+
+  graph->entrance_of[loc] = sp->count;
+  sp->entrance[sp->count] = loc;
+  sp->count += 1;
+}
+
+/*
+Look for entrances along one side of a sector.  'len' cells starting
+at 'loc' and 'step' apart lie along the side, and 'across' is the
+offset to the cell on the other side of the border.  Each run of
+cells that may be crossed on both sides gets an entrance at its
+middle.
+*/
+
+static void scan_border(sector_graph_t *graph, psector_t *sp, loc_t loc,
+                        int step, int across, int len) {
+  int i, start;
+
+  start = -1; /* no run yet */
+  for (i = 0; i <= len; i++, loc += step) {
+    if (i < len && sector_cross(graph, loc) &&
+        sector_cross(graph, loc + across)) {
+      if (start < 0) start = i;
+    } else if (start >= 0) {
+      add_entrance(graph, sp, loc - (i - (start + i - 1) / 2) * step);
+      start = -1;
+    }
+  }
+}
+
+/*
+Find the cost from a cell to each entrance of a sector, moving only
+within the sector.  The cell itself need not be one we may cross.
+*/
+
+static void sector_flood(sector_graph_t *graph, int sector, loc_t loc,
+                         short *cost) {
+  static long *seen; /* generation of flood that reached cell */
+  static long flood_generation = 0;
+  loc_t list[PSECTOR_SIZE * PSECTOR_SIZE + 1];
+  psector_t *sp = &graph->sector[sector];
+  loc_t new_loc;
+  int head, tail, level_end, cur_cost, i;
+
+  if (seen == NULL) seen = xalloc(MAP_SIZE, sizeof(long));
+  for (i = 0; i < sp->count; i++) cost[i] = NO_WAY;
+
+  flood_generation += 1;
+  seen[loc] = flood_generation;
+  list[0] = loc;
+  tail = 1;
+  level_end = 1;
+  cur_cost = 0;
+
+  for (head = 0; head < tail; head++) {
+    if (head == level_end) { /* start on next ring */
+      cur_cost += 1;
+      level_end = tail;
+    }
+    loc = list[head];
+    if (graph->entrance_of[loc] >= 0 && loc_psector(loc) == sector)
+      cost[graph->entrance_of[loc]] = cur_cost;
+
+    FOR_ADJ(loc, new_loc, i)
+    if (seen[new_loc] != flood_generation && loc_psector(new_loc) == sector &&
+        sector_cross(graph, new_loc)) {
+      seen[new_loc] = flood_generation;
+      list[tail] = new_loc;
+      tail += 1;
+    }
+  }
+}
+
+/* Find the entrances of a sector, and the costs between them. */
+
+static void build_sector(sector_graph_t *graph, int sector) {
+  psector_t *sp = &graph->sector[sector];
+  box_t box;
+  loc_t nw, ne, sw, se; /* corners of sector */
+  int width, height;
+  int row, col, i;
+
+  sector_box(&box, sector, 0);
+  for (row = box.row0; row <= box.row1; row++)
+    for (col = box.col0; col <= box.col1; col++)
+      graph->entrance_of[row_col_loc(row, col)] = -1;
+  sp->count = 0;
+
+  nw = row_col_loc(box.row0, box.col0);
+  ne = row_col_loc(box.row0, box.col1);
+  sw = row_col_loc(box.row1, box.col0);
+  se = row_col_loc(box.row1, box.col1);
+  width = box.col1 - box.col0 + 1;
+  height = box.row1 - box.row0 + 1;
+
+  if (box.row0 > 0) { /* north side and corners */
+    scan_border(graph, sp, nw, 1, -MAP_WIDTH, width);
+    if (box.col0 > 0) scan_border(graph, sp, nw, 0, -MAP_WIDTH - 1, 1);
+    if (box.col1 < MAP_WIDTH - 1)
+      scan_border(graph, sp, ne, 0, -MAP_WIDTH + 1, 1);
+  }
+  if (box.row1 < MAP_HEIGHT - 1) { /* south side and corners */
+    scan_border(graph, sp, sw, 1, MAP_WIDTH, width);
+    if (box.col0 > 0) scan_border(graph, sp, sw, 0, MAP_WIDTH - 1, 1);
+    if (box.col1 < MAP_WIDTH - 1)
+      scan_border(graph, sp, se, 0, MAP_WIDTH + 1, 1);
+  }
+  if (box.col0 > 0) /* west side */
+    scan_border(graph, sp, nw, MAP_WIDTH, -1, height);
+  if (box.col1 < MAP_WIDTH - 1) /* east side */
+    scan_border(graph, sp, ne, MAP_WIDTH, 1, height);
+
+  for (i = 0; i < sp->count; i++)
+    sector_flood(graph, sector, sp->entrance[i], sp->cost[i]);
+  sp->dirty = false;
+}
+
+/*
+Search a sector graph for a path from 'cur_loc' to 'dest_loc'.  The
+piece's sector is entered at 'cur_loc' and the destination's sector
+is left at 'dest_loc', and between them we move from entrance to
+entrance with an A* search.  We return the entrance by which the path
+leaves the piece's sector or, if the piece is already there, the
+entrance on the other side of the border.  If there is no path that
+costs less than 'beat_cost', we return 'cur_loc'.
+
+Costs are counted as for 'search_dest', and each step toward the
+entrance we return lowers the cost of the best path by one.
+*/
+
+static int *node_cost;   /* cost to reach each entrance */
+static int *node_est;    /* estimated total cost through it */
+static int *node_from;   /* entrance it is reached from */
+static long *node_stamp; /* generation of search reaching it */
+static int *node_heap;   /* entrances to expand, by estimate */
+static int *node_place;  /* place of entrance in heap, or -1 */
+static int heap_len;
+
+#define START_NODE (-1) /* 'node_from' of entrances in piece's sector */
+
+/* Move an entrance up the heap to its place. */
+
+static void heap_up(int i) {
+  int node = node_heap[i];
+
+  while (i > 0 && node_est[node_heap[(i - 1) / 2]] > node_est[node]) {
+    node_heap[i] = node_heap[(i - 1) / 2];
+    node_place[node_heap[i]] = i;
+    i = (i - 1) / 2;
+  }
+  node_heap[i] = node;
+  node_place[node] = i;
+}
+
+/* Remove the entrance with the lowest estimate from the heap. */
+
+static int heap_pop(void) {
+  int top = node_heap[0];
+  int node, i, child;
+
+  node_place[top] = -1;
+  heap_len -= 1;
+  if (heap_len == 0) return top;
+
+  node = node_heap[heap_len];
+  for (i = 0; (child = 2 * i + 1) < heap_len; i = child) {
+    if (child + 1 < heap_len &&
+        node_est[node_heap[child + 1]] < node_est[node_heap[child]])
+      child += 1;
+    if (node_est[node_heap[child]] >= node_est[node]) break;
+    node_heap[i] = node_heap[child];
+    node_place[node_heap[i]] = i;
+  }
+  node_heap[i] = node;
+  node_place[node] = i;
+  return top;
+}
 
-This is similar to 'find_objective' except that we know our destination.
+/* Reach an entrance at some cost, if that is the best way yet. */
+
+static void reach_node(sector_graph_t *graph, int node, int cost, int from,
+                       loc_t dest_loc, long gen) {
+  loc_t loc = graph->sector[node / MAX_ENTRANCES]
+                  .entrance[node % MAX_ENTRANCES];
+
+  if (node_stamp[node] == gen) {
+    if (cost >= node_cost[node] || node_place[node] < 0) return;
+  } else {
+    node_stamp[node] = gen;
+    node_place[node] = heap_len;
+    node_heap[heap_len] = node;
+    heap_len += 1;
+  }
+  node_cost[node] = cost;
+  node_est[node] = cost + dist(loc, dest_loc);
+  node_from[node] = from;
+  heap_up(node_place[node]);
+}
+
+static loc_t sector_find_dest(sector_graph_t *graph, loc_t cur_loc,
+                              loc_t dest_loc, int beat_cost)
+/* beat_cost = cost a path must beat to be of interest */
+{
+  static long search_generation = 0;
+  short start_cost[MAX_ENTRANCES]; /* cost from piece to each entrance */
+  short goal_cost[MAX_ENTRANCES];  /* cost from each entrance to dest */
+  int cur_sector, dest_sector, sector;
+  int node, next, way, out, i, j;
+  int goal_best, goal_from;
+  psector_t *sp;
+  loc_t loc, new_loc;
+
+  if (!graph->built) {
+    for (i = 0; i < NUM_PSECTORS; i++) graph->sector[i].dirty = true;
+    graph->built = true;
+  }
+  for (i = 0; i < NUM_PSECTORS; i++)
+    if (graph->sector[i].dirty) build_sector(graph, i);
+
+  cur_sector = loc_psector(cur_loc);
+  dest_sector = loc_psector(dest_loc);
+  sector_flood(graph, cur_sector, cur_loc, start_cost);
+  sector_flood(graph, dest_sector, dest_loc, goal_cost);
+
+  search_generation += 1;
+  heap_len = 0;
+  sp = &graph->sector[cur_sector];
+  for (i = 0; i < sp->count; i++)
+    if (start_cost[i] != NO_WAY)
+      reach_node(graph, cur_sector * MAX_ENTRANCES + i, start_cost[i],
+                 START_NODE, dest_loc, search_generation);
+
+  goal_best = beat_cost;
+  goal_from = START_NODE;
+  while (heap_len > 0 && node_est[node_heap[0]] < goal_best) {
+    node = heap_pop();
+    sector = node / MAX_ENTRANCES;
+    i = node % MAX_ENTRANCES;
+    sp = &graph->sector[sector];
+    loc = sp->entrance[i];
+
+    if (sector == dest_sector && goal_cost[i] != NO_WAY &&
+        node_cost[node] + goal_cost[i] < goal_best) {
+      goal_best = node_cost[node] + goal_cost[i];
+      goal_from = node;
+    }
+    for (j = 0; j < sp->count; j++) /* move within the sector */
+      if (sp->cost[i][j] != NO_WAY)
+        reach_node(graph, sector * MAX_ENTRANCES + j,
+                   node_cost[node] + sp->cost[i][j], node, dest_loc,
+                   search_generation);
+
+    FOR_ADJ_ON(loc, new_loc, j) /* cross into the next sector */
+    if (graph->entrance_of[new_loc] >= 0 && loc_psector(new_loc) != sector)
+      reach_node(graph,
+                 loc_psector(new_loc) * MAX_ENTRANCES +
+                     graph->entrance_of[new_loc],
+                 node_cost[node] + 1, node, dest_loc, search_generation);
+  }
+  if (goal_from == START_NODE) return cur_loc; /* no way there */
+
+  /* find the last entrance in our sector, and the one after it */
+  way = out = START_NODE;
+  for (next = START_NODE, node = goal_from; node != START_NODE;
+       next = node, node = node_from[node])
+    if (next != START_NODE && node / MAX_ENTRANCES == cur_sector &&
+        next / MAX_ENTRANCES != cur_sector) {
+      way = node;
+      out = next;
+    }
+  if (way == START_NODE) return cur_loc;
+
+  loc = graph->sector[cur_sector].entrance[way % MAX_ENTRANCES];
+  if (loc != cur_loc) return loc;
+  return graph->sector[out / MAX_ENTRANCES].entrance[out % MAX_ENTRANCES];
+}
+
+/*
+Find a path from the current location to the destination which
+passes over valid terrain.  We return the destination if a path
+exists.  Otherwise we return the origin.
+
+If a sector graph can be used, we look for a path that stays within
+the sectors around the destination, and for a path through the graph.
+If the path through the graph is better, we return the entrance on the
+way out of the piece's sector instead of the destination, and the path
+we leave in the path map leads to that entrance.  Either way the cost
+of the best path we know of drops with each move, so a piece always
+gets where it is going.  If neither finds a way, we search in full.
 */
 
-loc_t vmap_find_dest(path_map_t path_map[], view_map_t vmap[], loc_t cur_loc,
+loc_t vmap_find_dest(path_map_t *path_map, view_map_t vmap[], loc_t cur_loc,
                      loc_t dest_loc, int owner, int terrain)
 /* cur_loc = current location of piece */
 /* dest_loc = destination of piece */
 /* owner = owner of piece being moved */
 /* terrain = terrain we can cross */
 {
-  perimeter_t *from;
-  perimeter_t *to;
-  int cur_cost;
+  sector_graph_t *graph;
+  box_t box;
+  loc_t way;
+  int near_cost; /* cost of path near destination */
+
+  graph = find_graph(vmap, owner, terrain);
+  if (!graph)
+    return search_dest(path_map, vmap, cur_loc, dest_loc, owner, terrain,
+                       NULL);
+
+  near_cost = INFINITY;
+  sector_box(&box, loc_psector(dest_loc), 1);
+  if (IN_BOX(&box, cur_loc) && search_dest(path_map, vmap, cur_loc, dest_loc,
+                                           owner, terrain, &box) == dest_loc) {
+    near_cost = best_cost;
+    if (near_cost == dist(cur_loc, dest_loc)) return dest_loc; /* no better */
+  }
+  way = sector_find_dest(graph, cur_loc, dest_loc, near_cost);
+  if (way == cur_loc) { /* nothing better through the graph? */
+    if (near_cost != INFINITY) return dest_loc;
+    return search_dest(path_map, vmap, cur_loc, dest_loc, owner, terrain,
+                       NULL);
+  }
+  sector_box(&box, loc_psector(cur_loc), 0);
+  if (search_dest(path_map, vmap, cur_loc, way, owner, terrain,
+                  IN_BOX(&box, way) ? &box : NULL) == way)
+    return way;
+  return search_dest(path_map, vmap, cur_loc, dest_loc, owner, terrain, NULL);
+}
+
+/*
+Find the shortest path from the current location to the
+destination which passes over valid terrain.  We return
+the destination if a path exists.  Otherwise we return the
+origin.
+
+This is similar to 'find_objective' except that we know our destination,
+so rather than flooding outward in rings we use an A* search, with the
+distance to the destination as an estimate of the remaining cost.  Since
+every move costs one, the estimate never overstates the true cost, and
+the estimated total cost of a path rises by at most two from one cell
+to the next.  So instead of a heap we keep three perimeter lists, one
+for each total cost we may be adding cells to, and use them in rotation.
+
+We keep expanding until no cell remains whose estimated total does not
+exceed the cost of the destination.  That way every cell on any shortest
+path has its correct cost in the path map, and 'vmap_mark_path' and
+'vmap_find_dir' see the same paths that a full flood would give them.
+*/
+
+static loc_t search_dest(path_map_t *path_map, view_map_t vmap[],
+                         loc_t cur_loc, loc_t dest_loc, int owner,
+                         int terrain, box_t *box)
+/* box = cells to stay within, or NULL */
+{
+  perimeter_t *perim[3]; /* cells by estimated total cost, modulo 3 */
+  perimeter_t *curp;
+  int f; /* estimated total cost of cells being expanded */
   int start_terrain;
-  move_info_t move_info;
+  static move_info_t move_info = {0, "%", {1}};
   char old_contents;
+  long i;
 
   old_contents = vmap[dest_loc].contents;
   vmap[dest_loc].contents = '%'; /* mark objective */
   move_info.city_owner = owner;
-  move_info.objectives = "%";
-  move_info.weights[0] = 1;
 
-  from = &p1;
-  to = &p2;
+  perim[0] = &p1;
+  perim[1] = &p2;
+  perim[2] = &p3;
 
   if (terrain == T_AIR)
     start_terrain = T_LAND;
   else
     start_terrain = terrain;
 
-  start_perimeter(path_map, from, cur_loc, start_terrain);
-  cur_cost = 0; /* cost to reach current perimeter */
+  f = dist(cur_loc, dest_loc);
+  perim[0]->len = perim[1]->len = perim[2]->len = 0;
+  start_perimeter(path_map, perim[f % 3], cur_loc, start_terrain, &move_info);
 
-  for (;;) {
-    to->len = 0; /* nothing in perim yet */
-    expand_perimeter(path_map, vmap, &move_info, from, terrain, cur_cost, 1, 1,
-                     to, to);
-    cur_cost += 1;
-    if (to->len == 0 || best_cost <= cur_cost) {
-      vmap[dest_loc].contents = old_contents;
-      return best_loc;
+  while (f <= best_cost &&
+         perim[0]->len + perim[1]->len + perim[2]->len != 0) {
+    curp = perim[f % 3];
+
+    /* the list may grow as we go; cells whose cost has since dropped are
+       expanded from the list for their lower total instead */
+    for (i = 0; i < curp->len; i++)
+      if (path_map->cost[curp->list[i]] + dist(curp->list[i], dest_loc) == f)
+        expand_dest(path_map, vmap, &move_info, curp->list[i], dest_loc,
+                    terrain, box, perim);
+
+    curp->len = 0;
+    f += 1;
+  }
+  vmap[dest_loc].contents = old_contents;
+  return best_loc;
+}
+
+/*
+Expand one cell for 'search_dest'.  This follows 'expand_perimeter'
+except that each new cell goes on the list for its estimated total
+cost, and a cell we have already reached but not yet expanded may be
+reached again more cheaply, in which case we lower its cost and list
+it again.  A cell that has been expanded can never be improved upon.
+*/
+
+static void expand_dest(path_map_t *pmap, view_map_t *vmap,
+                        move_info_t *move_info, loc_t loc, loc_t dest_loc,
+                        int type, box_t *box, perimeter_t *perim[])
+/* loc = cell to expand */
+/* type = type of terrain to expand */
+/* box = cells to stay within, or NULL */
+/* perim = perimeter lists, indexed by estimated total cost modulo 3 */
+{
+  register int j;
+  loc_t new_loc;
+  int obj_cost;
+  int cur_cost = pmap->cost[loc];
+  register int new_type;
+  int gen = pmap->gen;
+
+  FOR_ADJ(loc, new_loc, j) {
+    int f = cur_cost + 1 + dist(new_loc, dest_loc);
+
+    if (pmap->stamp[new_loc] < gen) { /* not reached yet? */
+      if (box && !IN_BOX(box, new_loc)) continue;
+      new_type = terrain_type(pmap, vmap, move_info, loc, new_loc);
+
+      if ((new_type == T_LAND && (type & T_LAND)) ||
+          (new_type == T_WATER && (type & T_WATER)))
+        add_cell(pmap, new_loc, perim[f % 3], new_type, cur_cost, 1);
+      else if (new_type == T_UNKNOWN) { /* unreachable cell? */
+        pmap->stamp[new_loc] = gen;
+        pmap->terrain[new_loc] = new_type;
+        pmap->cost[new_loc] = cur_cost;
+        pmap->inc_cost[new_loc] = PMAP_FAR;
+      }
+      if (pmap->stamp[new_loc] == gen) { /* did we expand? */
+        obj_cost = objective_cost(vmap, move_info, new_loc, cur_cost);
+        if (obj_cost < best_cost) {
+          best_cost = obj_cost;
+          best_loc = new_loc;
+          if (new_type == T_UNKNOWN) {
+            pmap->cost[new_loc] = cur_cost + 2;
+            pmap->inc_cost[new_loc] = 2;
+          }
+        }
+      }
+    } else if (pmap->cost[new_loc] > cur_cost + 1 &&
+               (pmap->terrain[new_loc] == T_LAND ||
+                pmap->terrain[new_loc] == T_WATER)) {
+      pmap->cost[new_loc] = cur_cost + 1; /* cheaper way to unexpanded cell */
+      perim[f % 3]->list[perim[f % 3]->len] = new_loc;
+      perim[f % 3]->len += 1;
     }
-    SWAP(from, to);
   }
 }
 
 /*
-Starting with the destination, we recursively back track toward the source
+Starting with the destination, we back track toward the source
 marking all cells which are on a shortest path between the start and the
 destination.  To do this, we know the distance from the destination to
 the start.  The destination is on a path.  We then find the cells adjacent
@@ -881,22 +3731,63 @@ adjacent to P, the cost to reach S is less than the cost to reach P,
 and the cost to move from S to P is the difference in cost between
 S and P.
 
-Someday, this routine should probably use perimeter lists as well.
+We mark each square as we find it and put it on a list of squares
+whose neighbors we have yet to look at.  A square goes on the list at
+most once, so the list cannot overflow.
 */
 
+static perimeter_t path_list; /* marked squares left to look around */
+
 void vmap_mark_path(path_map_t *path_map, view_map_t *vmap, loc_t dest) {
   int n;
-  loc_t new_dest;
+  loc_t loc, new_loc;
+  long marked;
+
+  path_list.len = 0;
+  marked = push_path(path_map, dest);
+
+  while (path_list.len > 0) {
+    loc = path_list.list[--path_list.len];
+
+    /* mark adjacent squares on shortest path */
+    FOR_ADJ(loc, new_loc, n)
+    if (pmap_cost(path_map, new_loc) == pmap_pred_cost(path_map, loc))
+      marked += push_path(path_map, new_loc);
+  }
+  path_stats.mark_calls += 1;
+  path_stats.mark_cells += marked;
+  if (marked > path_stats.mark_most) path_stats.mark_most = marked;
+}
 
-  if (path_map[dest].cost == 0) return;         /* reached end of path */
-  if (path_map[dest].terrain == T_PATH) return; /* already marked */
+/*
+Mark a square found by 'vmap_mark_path', and put it on the list of
+squares to look around.  We return the number of squares marked.
+*/
+
+static int push_path(path_map_t *path_map, loc_t loc) {
+  if (!pmap_live(path_map, loc)) return 0;       /* not reached by search */
+  if (pmap_cost(path_map, loc) == 0) return 0;   /* reached end of path */
+  if (path_map->terrain[loc] == T_PATH) return 0; /* already marked */
+
+  path_map->terrain[loc] = T_PATH; /* this square is on path */
+  path_list.list[path_list.len] = loc;
+  path_list.len += 1;
+  return 1;
+}
 
-  path_map[dest].terrain = T_PATH; /* this square is on path */
+/*
+Mark a single cell as being on a path.  A cell which the current
+search never reached is first brought into the search with a cost
+of INFINITY, so that it is not mistaken for a cell on a shortest path.
+*/
 
-  /* loop to mark adjacent squares on shortest path */
-  FOR_ADJ(dest, new_dest, n)
-  if (path_map[new_dest].cost == path_map[dest].cost - path_map[dest].inc_cost)
-    vmap_mark_path(path_map, vmap, new_dest);
+static void mark_cell(path_map_t *path_map, loc_t loc) {
+  if (!pmap_live(path_map, loc)) {
+    path_map->stamp[loc] = path_map->gen;
+    path_map->cost[loc] = 0;
+    path_map->inc_cost[loc] = PMAP_NONE;
+  }
+  path_map->terrain[loc] = T_PATH;
 }
 
 /*
@@ -905,12 +3796,12 @@ starting location which are on the board.  'find_dir' must be
 invoked to decide which squares are actually valid.
 */
 
-void vmap_mark_adjacent(path_map_t path_map[], loc_t loc) {
+void vmap_mark_adjacent(path_map_t *path_map, loc_t loc) {
   int i;
   loc_t new_loc;
 
   FOR_ADJ_ON(loc, new_loc, i)
-  path_map[new_loc].terrain = T_PATH;
+  mark_cell(path_map, new_loc);
 }
 
 /*
@@ -919,7 +3810,7 @@ starting location which are on the board and which are adjacent
 to a location on the existing shortest path.
 */
 
-void vmap_mark_near_path(path_map_t path_map[], loc_t loc) {
+void vmap_mark_near_path(path_map_t *path_map, loc_t loc) {
   int i, j;
   loc_t new_loc, xloc;
   int hit_loc[8];
@@ -928,13 +3819,13 @@ void vmap_mark_near_path(path_map_t path_map[], loc_t loc) {
 
   FOR_ADJ_ON(loc, new_loc, i) {
     FOR_ADJ_ON(new_loc, xloc, j)
-    if (xloc != loc && path_map[xloc].terrain == T_PATH) {
+    if (xloc != loc && pmap_terrain(path_map, xloc) == T_PATH) {
       hit_loc[i] = 1;
       break;
     }
   }
   for (i = 0; i < 8; i++)
-    if (hit_loc[i]) path_map[loc + dir_offset[i]].terrain = T_PATH;
+    if (hit_loc[i]) mark_cell(path_map, loc + dir_offset[i]);
 }
 
 /*
@@ -966,26 +3857,28 @@ center of the best path.
 static int order[] = {NORTHWEST, NORTHEAST, SOUTHWEST, SOUTHEAST,
                       WEST,      EAST,      NORTH,     SOUTH};
 
-loc_t vmap_find_dir(path_map_t path_map[], view_map_t *vmap, loc_t loc,
+loc_t vmap_find_dir(path_map_t *path_map, view_map_t *vmap, loc_t loc,
                     char *terrain, char *adj_char) {
   int i, count, bestcount;
   loc_t bestloc, new_loc;
   int path_count, bestpath;
-  char *p;
+  char_set_t terrain_set;
+  uchar adj_weight[256];
 
   if (trace_pmap) print_pzoom("Before vmap_find_dir:", path_map, vmap);
 
+  make_char_set(&terrain_set, terrain);
+  make_adj_weights(adj_weight, adj_char);
+
   bestcount = -INFINITY; /* no best yet */
   bestpath = -1;
   bestloc = loc;
 
   for (i = 0; i < 8; i++) { /* for each adjacent square */
     new_loc = loc + dir_offset[order[i]];
-    if (path_map[new_loc].terrain == T_PATH) { /* which is on path */
-      p = strchr(terrain, vmap[new_loc].contents);
-
-      if (p != NULL) { /* desirable square? */
-        count = vmap_count_adjacent(vmap, new_loc, adj_char);
+    if (pmap_terrain(path_map, new_loc) == T_PATH) { /* which is on path */
+      if (IN_SET(terrain_set, vmap[new_loc].contents)) { /* desirable? */
+        count = count_adjacent(vmap, new_loc, adj_weight);
         path_count = vmap_count_path(path_map, new_loc);
 
         /* remember best location */
@@ -1008,22 +3901,48 @@ is the most interesting.
 */
 
 int vmap_count_adjacent(view_map_t *vmap, loc_t loc, char *adj_char) {
+  uchar adj_weight[256];
+
+  make_adj_weights(adj_weight, adj_char);
+  return count_adjacent(vmap, loc, adj_weight);
+}
+
+static int count_adjacent(view_map_t *vmap, loc_t loc, uchar *adj_weight) {
   int i, count;
   loc_t new_loc;
-  char *p;
-  int len;
-
-  len = strlen(adj_char);
 
   count = 0;
 
-  FOR_ADJ_ON(loc, new_loc, i) {
-    p = strchr(adj_char, vmap[new_loc].contents);
-    if (p) count += 8 * (len - (p - adj_char));
-  }
+  FOR_ADJ_ON(loc, new_loc, i)
+  count += adj_weight[(uchar)vmap[new_loc].contents];
+
   return (count);
 }
 
+/*
+Build the weights used when counting adjacent squares of interest.
+A character's weight is 8 times its distance from the end of the list.
+*/
+
+static void make_adj_weights(uchar *adj_weight, char *adj_char) {
+  int i, len;
+
+  len = strlen(adj_char);
+  (void)memset(adj_weight, '\0', 256);
+
+  for (i = len - 1; i >= 0; i--)
+    adj_weight[(uchar)adj_char[i]] = 8 * (len - i);
+}
+
+/* Build a set from a string of characters. */
+
+static void make_char_set(char_set_t *set, char *chars) {
+  (void)memset((char *)set, '\0', sizeof(char_set_t));
+
+  for (; *chars; chars++)
+    set->bits[(uchar)*chars >> 3] |= 1 << ((uchar)*chars & 7);
+}
+
 /*
 Count the number of adjacent cells that are on the path.
 */
@@ -1034,29 +3953,48 @@ int vmap_count_path(path_map_t *pmap, loc_t loc) {
 
   count = 0;
 
-  FOR_ADJ_ON(loc, new_loc, i)
-  if (pmap[new_loc].terrain == T_PATH) count += 1;
+  FOR_ADJ(loc, new_loc, i) /* edge cells are never on the path */
+  if (pmap_terrain(pmap, new_loc) == T_PATH) count += 1;
 
   return (count);
 }
 
 /*
-See if a location is on the shore.  We return true if a surrounding
-cell contains water and is on the board.
+Find the features of each cell on the board, from the neighbors of
+each cell.
 */
 
-bool rmap_shore(loc_t loc) {
-  loc_t i, j;
+#define IS_WATER(loc) (map[loc].contents == MAP_SEA)
 
-  FOR_ADJ_ON(loc, j, i)
-  if (map[j].contents == MAP_SEA) return (true);
+void rmap_find_features(void) {
+  loc_t loc, new_loc;
+  int i;
 
-  return (false);
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    map[loc].features = 0;
+    if (!map[loc].on_board) continue;
+
+    if (IS_WATER(loc)) map[loc].features |= F_AT_SEA;
+    FOR_ADJ_ON(loc, new_loc, i) {
+      if (IS_WATER(new_loc))
+        map[loc].features |= F_SHORE;
+      else
+        map[loc].features &= ~F_AT_SEA;
+    }
+  }
 }
 
+/*
+See if a location is on the shore.  We return true if a surrounding
+cell contains water and is on the board.
+*/
+
+bool rmap_shore(loc_t loc) { return (map[loc].features & F_SHORE) != 0; }
+
 bool vmap_shore(view_map_t *vmap, loc_t loc) {
   loc_t i, j;
 
+  if (!(map[loc].features & F_SHORE)) return (false);
   FOR_ADJ_ON(loc, j, i)
   if (vmap[j].contents != ' ' && vmap[j].contents != MAP_LAND &&
       map[j].contents == MAP_SEA)
@@ -1073,23 +4011,114 @@ which cannot be moved to are treated as ocean.
 bool vmap_at_sea(view_map_t *vmap, loc_t loc) {
   loc_t i, j;
 
-  if (map[loc].contents != MAP_SEA) return (false);
+  if (!(map[loc].features & F_AT_SEA)) return (false);
   FOR_ADJ_ON(loc, j, i)
-  if (vmap[j].contents == ' ' || vmap[j].contents == MAP_LAND ||
-      map[j].contents != MAP_SEA)
+  if (vmap[j].contents == ' ' || vmap[j].contents == MAP_LAND)
     return (false);
 
   return (true);
 }
 
-bool rmap_at_sea(loc_t loc) {
-  loc_t i, j;
+bool rmap_at_sea(loc_t loc) { return (map[loc].features & F_AT_SEA) != 0; }
+
+/*
+Allocate the storage of the map routines, once the size of the map is
+known.  Path maps and perimeter lists belonging to other modules are
+allocated by alloc_pmap() and alloc_perimeter().
+*/
+
+void alloc_perimeter(perimeter_t *perim) {
+  perim->len = 0;
+  perim->list = xalloc(MAP_SIZE, sizeof(long));
+}
 
-  if (map[loc].contents != MAP_SEA) return (false);
-  FOR_ADJ_ON(loc, j, i) {
-    if (map[j].contents != MAP_SEA) return (false);
+void alloc_pmap(path_map_t *pmap) {
+  pmap->cost = xalloc(MAP_SIZE, sizeof(unsigned short));
+  pmap->inc_cost = xalloc(MAP_SIZE, sizeof(uchar));
+  pmap->terrain = xalloc(MAP_SIZE, sizeof(uchar));
+  pmap->stamp = xalloc(MAP_SIZE, sizeof(unsigned short));
+  pmap->gen = 0;
+}
+
+void alloc_paths(void) {
+  int i;
+
+  alloc_perimeter(&p1);
+  alloc_perimeter(&p2);
+  alloc_perimeter(&p3);
+  alloc_perimeter(&path_list);
+  for (i = 0; i < NUM_FIELDS; i++)
+    fields[i].cost = xalloc(MAP_SIZE, sizeof(int));
+  for (i = 0; i < NUM_GRAPHS; i++) {
+    graphs[i].sector = xalloc(NUM_PSECTORS, sizeof(psector_t));
+    graphs[i].entrance_of = xalloc(MAP_SIZE, sizeof(signed char));
   }
-  return (true);
+  node_cost = xalloc(NUM_NODES, sizeof(int));
+  node_est = xalloc(NUM_NODES, sizeof(int));
+  node_from = xalloc(NUM_NODES, sizeof(int));
+  node_stamp = xalloc(NUM_NODES, sizeof(long));
+  node_heap = xalloc(NUM_NODES, sizeof(int));
+  node_place = xalloc(NUM_NODES, sizeof(int));
+
+  cont_parent = xalloc(MAP_SIZE + 1, sizeof(int));
+  for (i = 0; i < NUM_LABELINGS; i++) {
+    labelings[i].parent = xalloc(MAP_SIZE, sizeof(int));
+    labelings[i].next = xalloc(MAP_SIZE, sizeof(int));
+    labelings[i].last = xalloc(MAP_SIZE, sizeof(int));
+    labelings[i].cells = xalloc(MAP_SIZE, sizeof(int));
+    labelings[i].counts = xalloc(MAP_SIZE, sizeof(scan_counts_t));
+  }
+  label_stamp = xalloc(MAP_SIZE, sizeof(long));
+
+  for (i = 0; i < NUM_BASIN_SETS; i++) {
+    basin_sets[i].water = xalloc(MAP_SIZE, sizeof(int));
+    basin_sets[i].land = xalloc(MAP_SIZE, sizeof(int));
+    basin_sets[i].first = xalloc(MAP_SIZE + 2, sizeof(int));
+    basin_sets[i].shore = xalloc(MAP_SIZE, sizeof(int));
+    basin_sets[i].near_first = xalloc(MAP_SIZE + 1, sizeof(int));
+    basin_sets[i].near = xalloc(NEAR_POOL, sizeof(int));
+  }
+  cell_class = xalloc(MAP_SIZE, sizeof(uchar));
+  shore_pairs = xalloc(MAP_SIZE * 9, sizeof(*shore_pairs));
+  shore_sorted = xalloc(MAP_SIZE * 9, sizeof(int));
+  land_mark = xalloc(MAP_SIZE + 1, sizeof(long));
+  max_labels = MAP_SIZE / 20;
+  for (i = 0; i < NUM_BASIN_COUNTS; i++)
+    basin_counts[i].count = xalloc(max_labels * NUM_SLOTS, sizeof(int));
+  init_slots();
+
+  cont_graph.first = xalloc(MAP_SIZE + 2, sizeof(int));
+  cont_graph.cross = xalloc(MAX_CROSS_PAIRS * 2, sizeof(crossing_t));
+  cross_pairs = xalloc(MAX_CROSS_PAIRS, sizeof(cross_pair_t));
+  cross_from = xalloc(MAP_SIZE, sizeof(int));
+  cross_dist = xalloc(MAP_SIZE, sizeof(int));
+  cross_queue = xalloc(MAP_SIZE, sizeof(loc_t));
+  land_cost = xalloc(MAP_SIZE + 1, sizeof(int));
+  land_open = xalloc(MAP_SIZE, sizeof(int));
+  answers.stamp = xalloc(MAP_SIZE + 1, sizeof(long));
+  answers.cost = xalloc(MAP_SIZE + 1, sizeof(int));
+  answers.target = xalloc(MAP_SIZE + 1, sizeof(long));
+
+  pred_bodies = xalloc(MAP_SIZE + 1, sizeof(pred_body_t));
+  pred_live = xalloc(MAP_SIZE, sizeof(int));
+  pred_free = xalloc(MAP_SIZE, sizeof(int));
+  pred_pool = xalloc(PRED_POOL, sizeof(int));
+  body_of = xalloc(MAP_SIZE, sizeof(int));
+  next_cell = xalloc(MAP_SIZE, sizeof(loc_t));
+  pred_pass = xalloc(MAP_SIZE, sizeof(int));
+  pred_contents = xalloc(MAP_SIZE, sizeof(char));
+  land_count = xalloc(MAP_SIZE, sizeof(uchar));
+  water_count = xalloc(MAP_SIZE, sizeof(uchar));
+  pred_dirty = xalloc(MAP_SIZE, sizeof(loc_t));
+  is_dirty = xalloc(MAP_SIZE, sizeof(bool));
+  pred_queue = xalloc(MAP_SIZE, sizeof(loc_t));
+  pred_redo = xalloc(2 * MAP_SIZE, sizeof(loc_t));
+
+  for (i = 0; i < NUM_OVERLAYS; i++) {
+    overlays[i].list = xalloc(MAP_SIZE, sizeof(loc_t));
+    overlays[i].listed = xalloc(MAP_SIZE, sizeof(bool));
+  }
+  watch.listed = xalloc(MAP_SIZE, sizeof(bool));
 }
 
 /* end */
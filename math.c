@@ -34,6 +34,37 @@ long irand(long high) {
   return (rand() % high);
 }
 
+/*
+Fill in the row, column and sector of each location, so that
+loc_row(), loc_col() and loc_sector() are table lookups rather
+than divisions by the width of the map, and the offsets to the
+neighbors of a location.  Called by alloc_game() once the size
+of the map is known.
+*/
+
+void init_loc_tables(void) {
+  loc_t loc;
+  int row, col;
+
+  dir_offset[0] = -MAP_WIDTH;     /* north */
+  dir_offset[1] = -MAP_WIDTH + 1; /* northeast */
+  dir_offset[2] = 1;              /* east */
+  dir_offset[3] = MAP_WIDTH + 1;  /* southeast */
+  dir_offset[4] = MAP_WIDTH;      /* south */
+  dir_offset[5] = MAP_WIDTH - 1;  /* southwest */
+  dir_offset[6] = -1;             /* west */
+  dir_offset[7] = -MAP_WIDTH - 1; /* northwest */
+
+  for (loc = 0; loc < MAP_SIZE; loc++) {
+    row = loc / MAP_WIDTH;
+    col = loc % MAP_WIDTH;
+    loc_rows[loc] = row;
+    loc_cols[loc] = col;
+    loc_sectors[loc] =
+        row_col_sector(row / ROWS_PER_SECTOR, col / COLS_PER_SECTOR);
+  }
+}
+
 #ifdef __UNUSED__
 int rndint(int minp, int maxp) {
   int size;
@@ -17,6 +17,98 @@ object.c -- routines for manipulating objects.
 
 extern int get_piece_name(void);
 
+/*
+Index of pieces by block.  Each live piece is on the list of pieces
+of its owner and type in the block holding it, and we keep a count of
+each owner's pieces of each type.  produce(), move_obj(), kill_one()
+and kill_city() keep the index up to date;  init_game() and
+restore_game() build it again.
+*/
+
+static piece_info_t **blocks; /* heads of lists, by owner, type and block */
+static int piece_count[2][NUM_OBJECTS]; /* live pieces, by owner and type */
+
+#define BLOCK_HEAD(owner, type, block) \
+  blocks[((owner)-1) * NUM_OBJECTS * NUM_BLOCKS + (type)*NUM_BLOCKS + (block)]
+
+void alloc_index(void) {
+  blocks = xalloc(2 * NUM_OBJECTS * NUM_BLOCKS, sizeof(piece_info_t *));
+}
+
+/* Forget every piece, when a game starts or is restored. */
+
+void clear_index(void) {
+  (void)memset((char *)blocks, '\0',
+               2 * NUM_OBJECTS * NUM_BLOCKS * sizeof(piece_info_t *));
+  (void)memset((char *)piece_count, '\0', sizeof(piece_count));
+}
+
+/* Add a piece to the index, or take it out. */
+
+void index_piece(piece_info_t *obj) {
+  LINK(BLOCK_HEAD(obj->owner, obj->type, loc_block(obj->loc)), obj,
+       block_link);
+  piece_count[obj->owner - 1][obj->type] += 1;
+}
+
+static void unindex_piece(piece_info_t *obj) {
+  UNLINK(BLOCK_HEAD(obj->owner, obj->type, loc_block(obj->loc)), obj,
+         block_link);
+  piece_count[obj->owner - 1][obj->type] -= 1;
+}
+
+/* Move a piece to the list of its new block, if it has changed. */
+
+static void reindex_piece(piece_info_t *obj, loc_t old_loc) {
+  int old_block = loc_block(old_loc);
+
+  if (old_block == loc_block(obj->loc)) return;
+  UNLINK(BLOCK_HEAD(obj->owner, obj->type, old_block), obj, block_link);
+  LINK(BLOCK_HEAD(obj->owner, obj->type, loc_block(obj->loc)), obj,
+       block_link);
+}
+
+/*
+Return the first of an owner's pieces of a type in a block.  The
+rest follow through 'block_link'.
+*/
+
+piece_info_t *block_pieces(int owner, int type, int block) {
+  return BLOCK_HEAD(owner, type, block);
+}
+
+/* Return the number of pieces of a type an owner has. */
+
+int count_pieces(int owner, int type) { return piece_count[owner - 1][type]; }
+
+/*
+Count an owner's pieces of a type with a given function that are
+within 'radius' of a location.  We only look at the blocks that
+cells within 'radius' can be in.
+*/
+
+int count_near(int owner, int type, loc_t loc, int radius, long func) {
+  int row0, row1, col0, col1, row, col, count;
+  piece_info_t *p;
+
+  row0 = loc_row(loc) - radius;
+  row1 = loc_row(loc) + radius;
+  col0 = loc_col(loc) - radius;
+  col1 = loc_col(loc) + radius;
+  if (row0 < 0) row0 = 0;
+  if (row1 > MAP_HEIGHT - 1) row1 = MAP_HEIGHT - 1;
+  if (col0 < 0) col0 = 0;
+  if (col1 > MAP_WIDTH - 1) col1 = MAP_WIDTH - 1;
+
+  count = 0;
+  for (row = row0 / BLOCK_SIZE; row <= row1 / BLOCK_SIZE; row++)
+    for (col = col0 / BLOCK_SIZE; col <= col1 / BLOCK_SIZE; col++)
+      for (p = block_pieces(owner, type, row * BLOCK_COLS + col); p != NULL;
+           p = p->block_link.next)
+        if (p->func == func && dist(p->loc, loc) <= radius) count += 1;
+  return count;
+}
+
 /*
 Find the nearest city to a location.  Return the location
 of the city and the estimated cost to reach the city.
@@ -185,6 +277,7 @@ void kill_obj(piece_info_t *obj, loc_t loc) {
 void kill_one(piece_info_t **list, piece_info_t *obj) {
   UNLINK(list[obj->type], obj, piece_link); /* unlink obj from all lists */
   UNLINK(map[obj->loc].objp, obj, loc_link);
+  unindex_piece(obj);
   disembark(obj);
 
   LINK(free_list, obj, piece_link); /* return object to free list */
@@ -219,9 +312,11 @@ void kill_city(city_info_t *cityp) {
       }
       list = LIST(p->owner);
       UNLINK(list[p->type], p, piece_link);
+      unindex_piece(p);
       p->owner = (p->owner == USER ? COMP : USER);
       list = LIST(p->owner);
       LINK(list[p->type], p, piece_link);
+      index_piece(p);
 
       p->func = NOFUNC;
     }
@@ -230,6 +325,7 @@ void kill_city(city_info_t *cityp) {
   if (cityp->owner != UNOWNED) {
     vmap = MAP(cityp->owner);
     cityp->owner = UNOWNED;
+    vmap_forget_fields();
     cityp->work = 0;
     cityp->prod = NOPIECE;
 
@@ -271,6 +367,7 @@ void produce(city_info_t *cityp) {
   new->ship = NULL;
   new->count = 0;
   new->range = piece_attr[(int)cityp->prod].range;
+  index_piece(new);
 
   if (new->type == SATELLITE) { /* set random move direction */
     new->func = sat_dir[irand(4)];
@@ -302,12 +399,14 @@ void move_obj(piece_info_t *obj, loc_t new_loc) {
 
   UNLINK(map[old_loc].objp, obj, loc_link);
   LINK(map[new_loc].objp, obj, loc_link);
+  reindex_piece(obj, old_loc);
 
   /* move any objects contained in object */
   for (p = obj->cargo; p != NULL; p = p->cargo_link.next) {
     p->loc = new_loc;
     UNLINK(map[old_loc].objp, p, loc_link);
     LINK(map[new_loc].objp, p, loc_link);
+    reindex_piece(p, old_loc);
   }
 
   switch (obj->type) { /* board new ship */
@@ -520,6 +619,8 @@ city type.
 char city_char[] = {MAP_CITY, 'O', 'X'};
 
 void update(view_map_t vmap[], loc_t loc) {
+  int old_contents = vmap[loc].contents;
+
   vmap[loc].seen = date;
 
   if (map[loc].cityp) /* is there a city here? */
@@ -535,6 +636,9 @@ void update(view_map_t vmap[], loc_t loc) {
     else
       vmap[loc].contents = tolower(piece_attr[p->type].sname);
   }
+  if (vmap[loc].contents != old_contents)
+    vmap_changed(vmap, loc, old_contents);
+
   if (vmap == comp_map)
     display_locx(COMP, comp_map, loc);
   else if (vmap == user_map)
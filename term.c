@@ -346,8 +346,7 @@ void help(char **text, int nlines) {
   (void)refresh();
 }
 
-#define COL_DIGITS \
-  ((MAP_WIDTH <= 100) ? 2 : ((MAP_WIDTH <= 1000 ? 3 : (1 / 0))))
+#define COL_DIGITS ((MAP_WIDTH <= 100) ? 2 : 3) /* see MAX_MAP_WIDTH */
 
 int loc_disp(int loc) {
   int row = loc / MAP_WIDTH;
@@ -242,6 +242,17 @@ void move_random(piece_info_t *obj) {
   move_obj(obj, loc_list[i]); /* move the piece */
 }
 
+/* path maps must start out zeroed, so this one is not automatic */
+static path_map_t path_map;
+static view_map_t *amap; /* scratch map for move_armyload() */
+
+/* Allocate the maps used to move the user's pieces. */
+
+void alloc_user(void) {
+  amap = xalloc(MAP_SIZE, sizeof(view_map_t));
+  alloc_pmap(&path_map);
+}
+
 /*
 Have a piece explore.  We look for the nearest unexplored territory
 which the piece can reach and have to piece move toward the
@@ -249,33 +260,32 @@ territory.
 */
 
 void move_explore(piece_info_t *obj) {
-  path_map_t path_map[MAP_SIZE];
   loc_t loc;
   char *terrain;
 
   switch (obj->type) {
     case ARMY:
-      loc = vmap_find_lobj(path_map, user_map, obj->loc, &user_army);
+      loc = vmap_find_lobj(&path_map, user_map, obj->loc, &user_army);
       terrain = "+";
       break;
     case FIGHTER:
-      loc = vmap_find_aobj(path_map, user_map, obj->loc, &user_fighter);
+      loc = vmap_find_aobj(&path_map, user_map, obj->loc, &user_fighter);
       terrain = "+.O";
       break;
     default:
-      loc = vmap_find_wobj(path_map, user_map, obj->loc, &user_ship);
+      loc = vmap_find_wobj(&path_map, user_map, obj->loc, &user_ship);
       terrain = ".O";
       break;
   }
 
   if (loc == obj->loc) return; /* nothing to explore */
 
-  if (user_map[loc].contents == ' ' && path_map[loc].cost == 2)
-    vmap_mark_adjacent(path_map, obj->loc);
+  if (user_map[loc].contents == ' ' && pmap_cost(&path_map, loc) == 2)
+    vmap_mark_adjacent(&path_map, obj->loc);
   else
-    vmap_mark_path(path_map, user_map, loc);
+    vmap_mark_path(&path_map, user_map, loc);
 
-  loc = vmap_find_dir(path_map, user_map, obj->loc, terrain, " ");
+  loc = vmap_find_dir(&path_map, user_map, obj->loc, terrain, " ");
   if (loc != obj->loc) move_obj(obj, loc);
 }
 
@@ -304,8 +314,6 @@ If there is an adjacent transport, move the army onto
 the transport, and awaken the army.
 */
 
-static view_map_t amap[MAP_SIZE];
-
 void move_armyload(piece_info_t *obj) {
   loc_t loc;
   piece_info_t *p;
@@ -320,16 +328,16 @@ void move_armyload(piece_info_t *obj) {
     obj->func = NOFUNC;
   } else { /* look for nearest non-full transport */
     int i;
-    (void)memcpy(amap, user_map, sizeof(view_map_t) * MAP_SIZE);
+    vmap_overlay(amap, user_map);
 
     /* mark loading transports or cities building transports */
     for (p = user_obj[TRANSPORT]; p; p = p->piece_link.next)
       if (p->count < obj_capacity(p)) /* not full? */
-        amap[p->loc].contents = '$';
+        vmap_set_contents(amap, p->loc, '$');
 
     for (i = 0; i < NUM_CITY; i++)
       if (city[i].owner == USER && city[i].prod == TRANSPORT)
-        amap[city[i].loc].contents = '$';
+        vmap_set_contents(amap, city[i].loc, '$');
   }
 }
 
@@ -338,18 +346,17 @@ Move an army toward an attackable city or enemy army.
 */
 
 void move_armyattack(piece_info_t *obj) {
-  path_map_t path_map[MAP_SIZE];
   loc_t loc;
 
   ASSERT(obj->type == ARMY);
 
-  loc = vmap_find_lobj(path_map, user_map, obj->loc, &user_army_attack);
+  loc = vmap_find_lobj(&path_map, user_map, obj->loc, &user_army_attack);
 
   if (loc == obj->loc) return; /* nothing to attack */
 
-  vmap_mark_path(path_map, user_map, loc);
+  vmap_mark_path(&path_map, user_map, loc);
 
-  loc = vmap_find_dir(path_map, user_map, obj->loc, "+", "X*a");
+  loc = vmap_find_dir(&path_map, user_map, obj->loc, "+", "X*a");
   if (loc != obj->loc) move_obj(obj, loc);
 }
 
@@ -360,7 +367,6 @@ Move a ship toward port.  If the ship is healthy, wake it up.
 */
 
 void move_repair(piece_info_t *obj) {
-  path_map_t path_map[MAP_SIZE];
   loc_t loc;
 
   ASSERT(obj->type > FIGHTER);
@@ -375,14 +381,14 @@ void move_repair(piece_info_t *obj) {
     return;
   }
 
-  loc = vmap_find_wobj(path_map, user_map, obj->loc, &user_ship_repair);
+  loc = vmap_find_wobj(&path_map, user_map, obj->loc, &user_ship_repair);
 
   if (loc == obj->loc) return; /* no reachable city */
 
-  vmap_mark_path(path_map, user_map, loc);
+  vmap_mark_path(&path_map, user_map, loc);
 
   /* try to be next to ocean to avoid enemy pieces */
-  loc = vmap_find_dir(path_map, user_map, obj->loc, ".O", ".");
+  loc = vmap_find_dir(&path_map, user_map, obj->loc, ".O", ".");
   if (loc != obj->loc) move_obj(obj, loc);
 }
 
@@ -469,7 +475,6 @@ move.
 */
 
 void move_to_dest(piece_info_t *obj, loc_t dest) {
-  path_map_t path_map[MAP_SIZE];
   int fterrain;
   char *mterrain;
   loc_t new_loc;
@@ -489,11 +494,11 @@ void move_to_dest(piece_info_t *obj, loc_t dest) {
       break;
   }
 
-  new_loc = vmap_find_dest(path_map, user_map, obj->loc, dest, USER, fterrain);
+  new_loc = vmap_find_dest(&path_map, user_map, obj->loc, dest, USER, fterrain);
   if (new_loc == obj->loc) return; /* can't get there */
 
-  vmap_mark_path(path_map, user_map, dest);
-  new_loc = vmap_find_dir(path_map, user_map, obj->loc, mterrain, " .");
+  vmap_mark_path(&path_map, user_map, new_loc); /* dest or a way to it */
+  new_loc = vmap_find_dir(&path_map, user_map, obj->loc, mterrain, " .");
   if (new_loc == obj->loc) return; /* can't move ahead */
   ASSERT(good_loc(obj, new_loc));
   move_obj(obj, new_loc); /* everything looks good */
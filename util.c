@@ -43,6 +43,23 @@ void empend(void) {
   exit(0);
 }
 
+/*
+Allocate zeroed storage for 'count' items of 'size' bytes.  The
+storage lasts as long as the program, so there is nothing to free.
+If there is not enough memory, we can't play at all.
+*/
+
+void *xalloc(long count, long size) {
+  void *p;
+
+  p = calloc(count, size);
+  if (p == NULL) {
+    (void)printf("empire: not enough memory for a map this size.\n");
+    exit(1);
+  }
+  return (p);
+}
+
 /*
 Here is a little routine to perform consistency checking on the
 database.  I'm finding that my database is becoming inconsistent,
@@ -67,13 +84,20 @@ objects on the map have non-zero hits.
 cargo list.
 */
 
-static bool in_free[LIST_SIZE];  /* true if object in free list */
-static bool in_obj[LIST_SIZE];   /* true if object in obj list */
-static bool in_loc[LIST_SIZE];   /* true if object in a loc list */
-static bool in_cargo[LIST_SIZE]; /* true if object in a cargo list */
+static bool *in_free;  /* true if object in free list */
+static bool *in_obj;   /* true if object in obj list */
+static bool *in_loc;   /* true if object in a loc list */
+static bool *in_cargo; /* true if object in a cargo list */
+
+void alloc_check(void) {
+  in_free = xalloc(LIST_SIZE, sizeof(bool));
+  in_obj = xalloc(LIST_SIZE, sizeof(bool));
+  in_loc = xalloc(LIST_SIZE, sizeof(bool));
+  in_cargo = xalloc(LIST_SIZE, sizeof(bool));
+}
 
 void check(void) {
-  void check_cargo(), check_obj(), check_obj_cargo();
+  void check_cargo(), check_obj(), check_obj_cargo(), check_index();
 
   long i, j;
   piece_info_t *p;
@@ -127,6 +151,11 @@ void check(void) {
   check_obj(comp_obj, COMP);
   check_obj(user_obj, USER);
 
+  /* Scan the block index. */
+
+  check_index(comp_obj, COMP);
+  check_index(user_obj, USER);
+
   /* Scan cargo lists. */
 
   check_cargo(user_obj[TRANSPORT], ARMY);
@@ -175,6 +204,37 @@ void check_obj(piece_info_t **list, int owner) {
     }
 }
 
+/*
+Check the block index.  Each piece listed in a block must have the
+owner and type of the list and be in that block, and each owner must
+have as many pieces of each type in the index as in its object list.
+*/
+
+void check_index(piece_info_t **list, int owner) {
+  long i, n;
+  int block;
+  piece_info_t *p;
+
+  for (i = 0; i < NUM_OBJECTS; i++) {
+    n = 0;
+    for (block = 0; block < NUM_BLOCKS; block++)
+      for (p = block_pieces(owner, i, block); p != NULL;
+           p = p->block_link.next) {
+        ASSERT(p->owner == owner);
+        ASSERT(p->type == i);
+        ASSERT(loc_block(p->loc) == block);
+        n += 1;
+
+        if (p->block_link.prev)
+          ASSERT(p->block_link.prev->block_link.next == p);
+      }
+    ASSERT(n == count_pieces(owner, i));
+
+    for (p = list[i]; p != NULL; p = p->piece_link.next) n -= 1;
+    ASSERT(n == 0);
+  }
+}
+
 /*
 Check cargo lists.  We assume object lists are valid.
 as we will place bits in the 'in_cargo' array that are used by